@@ -29,16 +29,36 @@
 #include <chrono>
 #include <future>
 #include <complex>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
 #include "OffsceenSurface.h"
+#include "Symmetry.h"
 
 
 
+/* Disk that orbits entering it never leave, so they never escape either; radius 0 if there is none */
+template<typename T> struct InteriorTrap {
+    InteriorTrap(): center(0, 0), radius(0), period(0) {}
+    std::complex<T> center;
+    T radius;
+    /* Period of the attracting cycle center belongs to */
+    unsigned period;
+};
+
 template<typename T> class DynamicalSystem {
 public:
     virtual ~DynamicalSystem() {}
     virtual void init(std::complex<T> c) = 0;
     virtual std::complex<T> step() = 0;
     virtual std::complex<T> getVal() = 0;
+    /* Combination of Symmetry flags the orbits obey */
+    virtual unsigned getSymmetry() { return 0; }
+    /* Trap shared by all orbits, looked for in at most maxIter steps */
+    virtual InteriorTrap<T> getInteriorTrap(unsigned maxIter) { return InteriorTrap<T>(); }
+    /* Cheap test for initial values whose orbits are known to stay bounded, false if unsure */
+    virtual bool isKnownInterior(const std::complex<T> &) { return false; }
 };
 
 template<typename T> class AbstractRenderer {
@@ -48,6 +68,13 @@ public:
         topleft = std::complex<T>(-2,-2);
         bottomright = std::complex<T>(2,2);
         numIterations = 256;
+        numThreads = 0;
+        iterationCount = 0;
+        useSymmetry = true;
+        antialiasSamples = 0;
+        antialiasThreshold = 1.f/128;
+        histogramPixels = 0;
+        silentSince = 0;
     }
 
     void updateFactory(std::function<DynamicalSystem<T> *()> f) { factory = f; }
@@ -55,16 +82,125 @@ public:
     void setBounds(std::complex<T> tl, std::complex<T> br) { topleft = tl; bottomright = br; }
     void setIterations(unsigned it) { numIterations = it; }
     unsigned getIterations() { return numIterations;}
+    /* Number of worker threads, 0 means one per section */
+    void setThreads(unsigned n) { numThreads = n; }
+    /* Called from worker threads whenever new pixels reach the surface */
+    void setProgressFunc(std::function<void()> f) { progressFunc = f; }
+    /* Dynamical system steps executed by the last render */
+    uint64_t getIterationCount() { return iterationCount; }
+    /* Copy pixels mirrored by the symmetries of the system instead of rendering them */
+    void setSymmetry(bool on) { useSymmetry = on; }
+    /* Re-render pixels whose palette value differs by more than threshold from a neighbour's, or that differ
+     * in being painted black, as the average color of n jittered samples; 0 disables antialiasing */
+    void setAntialiasing(unsigned n, float threshold = 1.f/128) { antialiasSamples = n; antialiasThreshold = threshold; }
+    /* Rendered pixels of the last render by the step their orbit escaped or converged at, the last bin holds pixels
+     * still undecided at the iteration cap; mirrored, restored, trapped and known interior pixels are not binned */
+    const std::vector<uint64_t> &getEscapeHistogram() { return escapeHistogram; }
+
+    /* Iteration cap at which less than threshold of the rendered pixels would still escape per extra iteration,
+     * extrapolated from the escape histogram of the last render; the current cap if raising it is not worth it */
+    unsigned suggestIterations(double threshold = 1e-6, unsigned maxIterations = 1u << 16) {
+        unsigned n = escapeHistogram.empty() ? 0 : escapeHistogram.size() - 1;
+        if (n == 0 || histogramPixels == 0 || n >= maxIterations)
+            return numIterations;
+        if (double(escapeHistogram[n])/histogramPixels < threshold)
+            return n;
+        if (n < 8)
+            return std::min(maxIterations, 2*n);
+        /* Escape rates over the last two quarters of the orbits, assumed to decay as a power of the step count */
+        auto rate = [&](unsigned from, unsigned to) {
+            uint64_t sum = 0;
+            for (unsigned i = from; i < to; ++i)
+                sum += escapeHistogram[i];
+            return double(sum)/(to-from)/histogramPixels;
+        };
+        unsigned q1 = n/2, q2 = n - n/4;
+        double r1 = rate(q1, q2), r2 = rate(q2, n);
+        if (r2 < threshold && rate(0, n) > 0) {
+            silentSince = 0;
+            return n;
+        }
+        /* Nothing escaping at all tells apart neither interior nor deep views, so the cap keeps rising, but no further
+         * than 16x the cap nothing escaped at first: views inside components without an interior test settle there */
+        if (rate(0, n) == 0) {
+            if (silentSince == 0 || n < silentSince)
+                silentSince = n;
+            if (n >= 16*silentSince)
+                return n;
+        } else
+            silentSince = 0;
+        double next = 4.*n;
+        if (r2 < r1) {
+            double m1 = .5*(q1+q2), m2 = .5*(q2+n);
+            next = m2*std::pow(r2/threshold, std::log(m2/m1)/std::log(r1/r2));
+        }
+        if (next <= n)
+            return n;
+        return unsigned(std::min<double>(std::min(maxIterations, 16*n), std::ceil(next)));
+    }
 
 protected:
+    void notifyProgress() { if (progressFunc) progressFunc(); }
+    /* Pixels of the current view mirrored by symmetries of the system */
+    SymmetryMap getSymmetryMap() {
+        if (!useSymmetry) return SymmetryMap();
+        DynamicalSystem<T> *sys = factory();
+        SymmetryMap rc(sys->getSymmetry(), topleft, bottomright, surface->getWidth(), surface->getHeight());
+        delete sys;
+        return rc;
+    }
+
+    /* Offsets of pixels of the surface differing from a horizontal or vertical neighbour by differ(offset, offset) */
+    template<typename F> std::vector<size_t> findEdgePixels(F differ) {
+        size_t w = surface->getWidth(), h = surface->getHeight();
+        std::vector<bool> edge(w*h, false);
+        for (size_t y = 0; y < h; ++y)
+            for (size_t x = 0; x < w; ++x) {
+                size_t i = y*w + x;
+                if (x+1 < w && differ(i, i+1))
+                    edge[i] = edge[i+1] = true;
+                if (y+1 < h && differ(i, i+w))
+                    edge[i] = edge[i+w] = true;
+            }
+        std::vector<size_t> rc;
+        for (size_t i = 0; i < edge.size(); ++i)
+            if (edge[i]) rc.push_back(i);
+        return rc;
+    }
+
+    /* Sample k of antialiasSamples within pixel (x, y): one random point per cell of a stratified grid,
+     * hashed from the coordinates so that renders are repeatable regardless of scheduling */
+    std::complex<T> getSubpixelPoint(unsigned x, unsigned y, unsigned k) {
+        unsigned side = unsigned(std::ceil(std::sqrt(double(antialiasSamples))));
+        uint64_t h = (uint64_t(y) << 40) ^ (uint64_t(x) << 16) ^ k;
+        h = (h ^ (h >> 30))*0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27))*0x94d049bb133111ebull;
+        h ^= h >> 31;
+        T jx = ((k % side) + T(h & 0xffffffff)/T(4294967296.))/side;
+        T jy = ((k / side % side) + T(h >> 32)/T(4294967296.))/side;
+        std::complex<T> stepx((bottomright.real()-topleft.real())/surface->getWidth(), 0);
+        std::complex<T> stepy(0, (bottomright.imag()-topleft.imag())/surface->getHeight());
+        return topleft + (T(y) + jy)*stepy + (T(x) + jx)*stepx;
+    }
+
     /* Bounding box*/
     std::complex<T> topleft,bottomright;
 
     OffscreenSurface *surface;
     /* Renderer parameters*/
     unsigned numIterations;
+    unsigned numThreads;
+    uint64_t iterationCount;
+    bool useSymmetry;
+    unsigned antialiasSamples;
+    float antialiasThreshold;
+    std::vector<uint64_t> escapeHistogram;
+    uint64_t histogramPixels;
+    /* Lowest cap of the renders in a row in which nothing escaped, 0 once something did */
+    unsigned silentSince;
     /* The system itself*/
     std::function< DynamicalSystem<T> *()> factory;
+    std::function<void()> progressFunc;
 };
 
 #endif /* defined(__Mandelbrot__AbstractRenderer__) */
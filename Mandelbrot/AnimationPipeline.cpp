@@ -0,0 +1,115 @@
+/*
+ * Frame-parallel offline animation pipeline
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "AnimationPipeline.h"
+#include "Trace.h"
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+AnimationPipeline::AnimationPipeline(unsigned w, unsigned h, Palette &p): width(w), height(h), palette(p)
+{
+    renderThreads = std::max(1u, std::thread::hardware_concurrency());
+    encoderThreads = 2;
+    queueDepth = 2*renderThreads;
+}
+
+double AnimationPipeline::run(unsigned numFrames, FrameFunc render, FrameFunc encode)
+{
+    auto start = std::chrono::steady_clock::now();
+    /* Every frame in flight owns a surface, and the lowest one in flight always has one,
+     * so encoders waiting for it can not deadlock the renderers */
+    std::vector<std::unique_ptr<OffscreenSurface> > surfaces;
+    for (unsigned i(0); i < std::max(queueDepth, 1u); ++i) {
+        surfaces.emplace_back(new OffscreenSurface(width, height, palette));
+        freeSurfaces.push_back(surfaces.back().get());
+    }
+    nextFrame = nextEncoded = 0;
+
+    std::vector<std::thread> threads;
+    for (unsigned i(0); i < std::max(renderThreads, 1u); ++i)
+        threads.emplace_back(&AnimationPipeline::renderLoop, this, numFrames, render);
+    for (unsigned i(0); i < std::max(encoderThreads, 1u); ++i)
+        threads.emplace_back(&AnimationPipeline::encodeLoop, this, numFrames, encode);
+    for (auto &t: threads)
+        t.join();
+
+    freeSurfaces.clear();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop-start).count();
+}
+
+void AnimationPipeline::renderLoop(unsigned numFrames, FrameFunc render)
+{
+    Trace::setThreadName("pipeline render");
+    while (true) {
+        OffscreenSurface *s;
+        unsigned idx;
+        {
+            TRACE_SCOPE("waitForSurface");
+            std::unique_lock<std::mutex> guard(lock);
+            surfaceFreed.wait(guard, [this, numFrames] { return !freeSurfaces.empty() || nextFrame >= numFrames; });
+            if (nextFrame >= numFrames) return;
+            s = freeSurfaces.back();
+            freeSurfaces.pop_back();
+            idx = nextFrame++;
+        }
+        {
+            TRACE_SCOPE("renderFrame");
+            render(idx, s);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        readyFrames[idx] = s;
+        frameReady.notify_all();
+    }
+}
+
+void AnimationPipeline::encodeLoop(unsigned numFrames, FrameFunc encode)
+{
+    Trace::setThreadName("pipeline encode");
+    while (true) {
+        OffscreenSurface *s;
+        unsigned idx;
+        {
+            TRACE_SCOPE("waitForFrame");
+            std::unique_lock<std::mutex> guard(lock);
+            frameReady.wait(guard, [this, numFrames] { return nextEncoded >= numFrames || readyFrames.count(nextEncoded); });
+            if (nextEncoded >= numFrames) return;
+            idx = nextEncoded++;
+            s = readyFrames[idx];
+            readyFrames.erase(idx);
+            /* Next frame may already be waiting for another encoder */
+            frameReady.notify_all();
+        }
+        {
+            TRACE_SCOPE("encodeFrame");
+            encode(idx, s);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        freeSurfaces.push_back(s);
+        surfaceFreed.notify_all();
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Frame-parallel offline animation pipeline
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_AnimationPipeline_h
+#define Mandelbrot_AnimationPipeline_h
+
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <map>
+#include "OffsceenSurface.h"
+
+/* Renders many frames concurrently and hands them to encoder threads in frame order.
+ * At most queueDepth frames are alive at any time, so fast renderers block on slow encoders */
+class AnimationPipeline {
+public:
+    typedef std::function<void(unsigned, OffscreenSurface *)> FrameFunc;
+
+    AnimationPipeline(unsigned width, unsigned height, Palette &p);
+    void setRenderThreads(unsigned n) { renderThreads = n; }
+    /* Frames are handed to encoders in order; use single encoder when output must be written in order too */
+    void setEncoderThreads(unsigned n) { encoderThreads = n; }
+    void setQueueDepth(unsigned n) { queueDepth = n; }
+    /* Returns time in milliseconds */
+    double run(unsigned numFrames, FrameFunc render, FrameFunc encode);
+
+private:
+    void renderLoop(unsigned numFrames, FrameFunc render);
+    void encodeLoop(unsigned numFrames, FrameFunc encode);
+
+    unsigned width, height;
+    Palette palette;
+    unsigned renderThreads, encoderThreads, queueDepth;
+
+    std::mutex lock;
+    std::condition_variable surfaceFreed, frameReady;
+    std::vector<OffscreenSurface *> freeSurfaces;
+    std::map<unsigned, OffscreenSurface *> readyFrames;
+    unsigned nextFrame, nextEncoded;
+};
+
+#endif
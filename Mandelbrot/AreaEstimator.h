@@ -0,0 +1,194 @@
+/*
+ * Monte Carlo area estimation of the set of bounded orbits
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_AreaEstimator_h
+#define Mandelbrot_AreaEstimator_h
+#include <functional>
+#include <complex>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "AbstractRenderer.h"
+#include "Complex.h"
+#include "Trace.h"
+
+/* Neumaier's variant of Kahan summation, exact up to the final rounding for sums of a few billion terms */
+class CompensatedSum {
+public:
+    CompensatedSum(): sum(0), compensation(0) {}
+    void add(double x) {
+        double t = sum + x;
+        compensation += std::fabs(sum) >= std::fabs(x) ? (sum - t) + x : (x - t) + sum;
+        sum = t;
+    }
+    double get() const { return sum + compensation; }
+
+private:
+    double sum, compensation;
+};
+
+struct AreaEstimate {
+    AreaEstimate(): area(0), stdError(0), samples(0), undecided(0), steps(0), ms(0) {}
+    double area, stdError;
+    uint64_t samples;
+    /* Samples still bounded at the iteration cap, counted as inside; bounds the bias of the estimate */
+    uint64_t undecided;
+    uint64_t steps;
+    double ms;
+    /* 95% confidence interval */
+    double low() const { return area - 1.96*stdError; }
+    double high() const { return area + 1.96*stdError; }
+};
+
+/* Estimates the area of initial values with bounded orbits from a fixed number of random samples in each cell
+ * of a strata*strata grid. Sample positions are hashed from the seed, cell and sample index, and counts are kept
+ * per cell and reduced in cell order once all threads are done, so results do not depend on the thread count */
+template<typename T> class AreaEstimator {
+public:
+    AreaEstimator(std::function<DynamicalSystem<T> *()> f): factory(f), topleft(-2, -2), bottomright(2, 2),
+        numStrata(1024), stratumSamples(4), numIterations(1<<16), numThreads(0), seed(1) {}
+
+    /* Region containing the whole set, halved for systems with conjugate symmetry if it is symmetric too */
+    void setBounds(std::complex<T> tl, std::complex<T> br) { topleft = tl; bottomright = br; }
+    void setStrata(unsigned side) { numStrata = std::max(side, 1u); }
+    /* At least two, so that the variance within cells can be estimated */
+    void setStratumSamples(unsigned n) { stratumSamples = std::max(n, 2u); }
+    void setIterations(unsigned it) { numIterations = it; }
+    /* Number of worker threads, 0 means one per core */
+    void setThreads(unsigned n) { numThreads = n; }
+    void setSeed(uint64_t s) { seed = s; }
+
+    AreaEstimate estimate() {
+        TRACE_SCOPE("estimate");
+        auto start = std::chrono::steady_clock::now();
+        DynamicalSystem<T> *sys = factory();
+        bool halve = (sys->getSymmetry() & ConjugateSymmetry) && topleft.imag() == -bottomright.imag();
+        trap = sys->getInteriorTrap(numIterations);
+        delete sys;
+        origin = halve ? std::complex<T>(topleft.real(), 0) : topleft;
+        cellSize = std::complex<T>((bottomright.real() - origin.real())/numStrata, (bottomright.imag() - origin.imag())/numStrata);
+        size_t cells = size_t(numStrata)*numStrata;
+        inside.assign(cells, 0);
+        undecided.assign(cells, 0);
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> steps(0);
+        unsigned threads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::future<void> > rc;
+        for (unsigned i = 1; i < threads; ++i)
+            rc.push_back(std::async(std::launch::async, &AreaEstimator::sampleCells, this, &next, &steps));
+        sampleCells(&next, &steps);
+        for (auto &r: rc)
+            r.get();
+
+        /* Stratified estimator: sum of cell areas times the fraction of their samples inside,
+         * its variance the sum of cell variances of those fractions */
+        TRACE_SCOPE("reduce");
+        double cellArea = std::fabs(double(cellSize.real())*double(cellSize.imag()))*(halve ? 2 : 1);
+        double k = stratumSamples;
+        CompensatedSum area, variance;
+        AreaEstimate result;
+        for (size_t i = 0; i < cells; ++i) {
+            double p = inside[i]/k;
+            area.add(cellArea*p);
+            variance.add(cellArea*cellArea*p*(1 - p)/(k - 1));
+            result.undecided += undecided[i];
+        }
+        result.area = area.get();
+        result.stdError = std::sqrt(variance.get());
+        result.samples = cells*stratumSamples;
+        result.steps = steps;
+        result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    enum Outcome { Escaped, Inside, Undecided };
+
+    /* Orbits revisiting the point saved at the last power of two step are periodic, hence bounded */
+    Outcome classify(DynamicalSystem<T> *sys, const std::complex<T> &c, uint64_t &steps) {
+        if (sys->isKnownInterior(c)) return Inside;
+        sys->init(c);
+        T trapRadius2 = trap.radius*trap.radius;
+        Complex<T> saved = sys->getVal();
+        for (unsigned i = 0; i < numIterations; ++i) {
+            Complex<T> x = sys->step();
+            if (norm(x) > 4.0) {
+                steps += i + 1;
+                return Escaped;
+            }
+            if (norm(x - saved) < T(1e-20) || (trapRadius2 > 0 && norm(x - trap.center) < trapRadius2)) {
+                steps += i + 1;
+                return Inside;
+            }
+            if ((i & (i + 1)) == 0)
+                saved = x;
+        }
+        steps += numIterations;
+        return Undecided;
+    }
+
+    /* Sample j of the cell, a counter based hash of the seed, cell and sample index */
+    std::complex<T> getSample(size_t cell, unsigned j) {
+        uint64_t h = seed*0x9e3779b97f4a7c15ull ^ (uint64_t(cell) << 20) ^ j;
+        h = (h ^ (h >> 30))*0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27))*0x94d049bb133111ebull;
+        h ^= h >> 31;
+        T fx = T(h & 0xffffffff)/T(4294967296.), fy = T(h >> 32)/T(4294967296.);
+        return origin + std::complex<T>((cell % numStrata + fx)*cellSize.real(), (cell / numStrata + fy)*cellSize.imag());
+    }
+
+    /* Classify samples of rows of cells picked from the shared counter until all are done */
+    void sampleCells(std::atomic<size_t> *next, std::atomic<uint64_t> *steps) {
+        DynamicalSystem<T> *sys = factory();
+        uint64_t n = 0;
+        for (size_t row = (*next)++; row < numStrata; row = (*next)++) {
+            TRACE_SCOPE("row");
+            for (size_t cell = row*numStrata; cell < (row + 1)*numStrata; ++cell)
+                for (unsigned j = 0; j < stratumSamples; ++j) {
+                    auto rc = classify(sys, getSample(cell, j), n);
+                    inside[cell] += rc != Escaped;
+                    undecided[cell] += rc == Undecided;
+                }
+        }
+        delete sys;
+        *steps += n;
+    }
+
+    std::function<DynamicalSystem<T> *()> factory;
+    std::complex<T> topleft, bottomright;
+    unsigned numStrata, stratumSamples, numIterations, numThreads;
+    uint64_t seed;
+    std::complex<T> origin, cellSize;
+    InteriorTrap<T> trap;
+    /* Samples per cell with bounded orbits, and those of them only bounded up to the iteration cap */
+    std::vector<uint32_t> inside, undecided;
+};
+
+#endif
@@ -27,27 +27,38 @@
 #define Mandelbrot_AttractionPointRenderer_h
 #include <complex>
 #include <iostream>
+#include <vector>
 #include "AbstractRenderer.h"
+#include "Complex.h"
+#include "Trace.h"
 
 template<typename T> class AttractionPointRenderer: public AbstractRenderer<T> {
 private:
     std::pair<std::complex<T>, float>  computeAttractionTime(DynamicalSystem<T> *sys, const std::complex<T> &x0) {
-        auto px = x0;
+        Complex<T> px = x0;
         sys->init(x0);
         for (unsigned steps(0); steps < numIterations; ++steps) {
-            auto x = sys->step();
+            Complex<T> x = sys->step();
             auto diff = x-px;
             px = x;
             if (norm(diff) < 1e-8) {
+                iterationCount += steps + 1;
                 return std::pair<std::complex<T>, float> (x, steps);
             }
         }
+        iterationCount += numIterations;
         return std::pair<std::complex<T>, float> (x0, numIterations);
     }
 
 public:
 
-    AttractionPointRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): AbstractRenderer<T>(s,f) {}
+    AttractionPointRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): AbstractRenderer<T>(s,f), verbose(false) {}
+
+    /* Report newly found attraction points on stdout, off by default so that embedding programs stay quiet */
+    void setVerbose(bool v) { verbose = v; }
+
+    /* Known attraction points, e.g. roots from a catalog, keep colors stable regardless of discovery order */
+    void setAttractionPoints(const std::vector<std::complex<T>> &points) { attractionPoints = points; }
 
     unsigned getAttractionPointIndex(const std::complex<T> &point) {
         unsigned idx=0;
@@ -56,7 +67,8 @@ public:
                 break;
             else idx++;
         if (idx >= attractionPoints.size()) {
-            std::cout<<"Adding "<<(idx+1)<<" attraction point"<<point<<std::endl;
+            if (verbose)
+                std::cout<<"Adding "<<(idx+1)<<" attraction point"<<point<<std::endl;
             attractionPoints.push_back(point);
         }
         return idx;
@@ -64,6 +76,7 @@ public:
 
     /*Return area and time in milliseconds */
     std::pair<T,T> render(void) {
+        TRACE_SCOPE("render");
         auto start = std::chrono::steady_clock::now();
         float invIterations = 1.f/numIterations;
         auto width = surface->getWidth();
@@ -71,16 +84,43 @@ public:
         std::complex<T> stepx((bottomright.real()-topleft.real())/width,0);
         std::complex<T> stepy(0, (bottomright.imag()-topleft.imag())/height);
         DynamicalSystem<T> *sys = factory();
-        for(auto y(0); y<height;y++)
+        iterationCount = 0;
+        escapeHistogram.assign(numIterations+1, 0);
+        histogramPixels = 0;
+        /* Attraction point index and time of every pixel, kept for its mirror images and for antialiasing */
+        auto symmetry = getSymmetryMap();
+        std::vector<std::pair<int, float> > results(symmetry.isEmpty() && antialiasSamples < 2 ? 0 : size_t(width)*height);
+        for(auto y(0); y<height;y++) {
+            TRACE_SCOPE("row");
             for(auto x(0); x<width;x++) {
-                auto c = computeAttractionTime(sys, topleft + ((T)y)*stepy + ((T)x)*stepx);
+                unsigned sx, sy;
+                auto mirror = symmetry.getSource(x, y, sx, sy);
+                std::pair<std::complex<T>, float> c;
+                if (mirror == SymmetryMap::Identity) {
+                    c = computeAttractionTime(sys, topleft + ((T)y)*stepy + ((T)x)*stepx);
+                    escapeHistogram[std::min<unsigned>(c.second, numIterations)]++;
+                    histogramPixels++;
+                } else {
+                    /* Orbit of the mirror image converges to the mirror image of the point */
+                    auto &src = results[size_t(sy)*width+sx];
+                    c.second = src.second;
+                    if (src.first >= 0)
+                        c.first = SymmetryMap::apply(mirror, attractionPoints[src.first]);
+                }
+                int idx = -1;
                 if (c.second >= numIterations)
                     surface->putPixel(x, y, 0, 0, 0);
                 else {
-                    auto idx = getAttractionPointIndex(c.first);
+                    idx = getAttractionPointIndex(c.first);
                     surface->putPixel(x, y, (float(idx)/attractionPoints.size())+c.second*invIterations);
                 }
+                if (!results.empty())
+                    results[size_t(y)*width+x] = std::make_pair(idx, c.second);
             }
+            notifyProgress();
+        }
+        if (antialiasSamples > 1)
+            antialias(sys, results);
         delete sys;
         auto stop = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop-start).count();
@@ -88,8 +128,29 @@ public:
     }
 
 private:
+    /* Supersample pixels converging to a different point than a neighbour, or at a different speed */
+    void antialias(DynamicalSystem<T> *sys, const std::vector<std::pair<int, float> > &results) {
+        TRACE_SCOPE("antialias");
+        float invIterations = 1.f/numIterations;
+        auto edges = findEdgePixels([&](size_t a, size_t b) {
+            return results[a].first != results[b].first || std::fabs(results[a].second - results[b].second)*invIterations > antialiasThreshold;
+        });
+        std::vector<float> samples(antialiasSamples);
+        unsigned width = surface->getWidth();
+        for (auto i: edges) {
+            unsigned x = i % width, y = i / width;
+            for (unsigned k = 0; k < antialiasSamples; ++k) {
+                auto c = computeAttractionTime(sys, getSubpixelPoint(x, y, k));
+                samples[k] = c.second >= numIterations ? -1 : float(getAttractionPointIndex(c.first))/attractionPoints.size()+c.second*invIterations;
+            }
+            surface->putSamples(x, y, samples.data(), antialiasSamples);
+        }
+        notifyProgress();
+    }
+
     /* Attraction points */
     std::vector<std::complex<T>> attractionPoints;
+    bool verbose;
 
     /* Bounding box*/
     using AbstractRenderer<T>::topleft;
@@ -100,8 +161,17 @@ private:
 
     /* Renderer parameters*/
     using AbstractRenderer<T>::numIterations;
+    using AbstractRenderer<T>::iterationCount;
     /* The system itself*/
     using AbstractRenderer<T>::factory;
+    using AbstractRenderer<T>::notifyProgress;
+    using AbstractRenderer<T>::getSymmetryMap;
+    using AbstractRenderer<T>::antialiasSamples;
+    using AbstractRenderer<T>::antialiasThreshold;
+    using AbstractRenderer<T>::findEdgePixels;
+    using AbstractRenderer<T>::getSubpixelPoint;
+    using AbstractRenderer<T>::escapeHistogram;
+    using AbstractRenderer<T>::histogramPixels;
 };
 
 
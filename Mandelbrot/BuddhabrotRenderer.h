@@ -0,0 +1,261 @@
+/*
+ * Orbit density (Buddhabrot) renderer
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_BuddhabrotRenderer_h
+#define Mandelbrot_BuddhabrotRenderer_h
+#include <complex>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "AbstractRenderer.h"
+#include "Complex.h"
+#include "Trace.h"
+
+/* Plots every point visited by orbits of randomly sampled initial values that escape, instead of coloring
+ * the initial values themselves. Threads sample into histograms of their own, merged once per round;
+ * every round repaints the surface and notifies progress, so that long runs can be previewed */
+template<typename T> class BuddhabrotRenderer: public AbstractRenderer<T> {
+public:
+    BuddhabrotRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): AbstractRenderer<T>(s,f),
+        numSamples(1<<24), roundSamples(1<<20), minIterations(0), importanceSampling(false), seed(1),
+        sampleTopLeft(-2, -2), sampleBottomRight(2, 2), orbitCount(0), stepCount(0) {}
+
+    void setSamples(uint64_t n) { numSamples = n; }
+    /* Samples taken in between histogram merges */
+    void setRoundSamples(uint64_t n) { roundSamples = std::max<uint64_t>(n, 1); }
+    /* Orbits escaping in fewer steps are not plotted */
+    void setMinIterations(unsigned n) { minIterations = n; }
+    /* Region initial values are sampled from, the escape disk by default */
+    void setSampleBounds(std::complex<T> tl, std::complex<T> br) { sampleTopLeft = tl; sampleBottomRight = br; }
+    /* Sample cells in proportion to what their orbits contributed in a coarse pre-pass, weighting orbits back;
+     * pays off for views zoomed into part of the set, uniform sampling is better for the whole of it */
+    void setImportanceSampling(bool on) { importanceSampling = on; }
+    void setSeed(uint64_t s) { seed = s; }
+    /* Weighted orbit points per pixel of the last render */
+    const std::vector<double> &getHistogram() const { return histogram; }
+
+    /* Return number of plotted orbits and time in milliseconds */
+    std::pair<T,T> render(void) {
+        TRACE_SCOPE("render");
+        auto start = std::chrono::steady_clock::now();
+        unsigned threads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+        size_t pixels = size_t(surface->getWidth())*surface->getHeight();
+        histogram.assign(pixels, 0);
+        threadHistograms.assign(threads, std::vector<double>(pixels, 0));
+        stepCount = 0;
+        orbitCount = 0;
+        buildImportanceMap(threads);
+        uint64_t done = 0;
+        for (unsigned round = 0; done < numSamples; ++round) {
+            TRACE_SCOPE("round");
+            uint64_t n = std::min(roundSamples, numSamples - done);
+            std::vector<std::future<void> > rc;
+            for (unsigned i = 1; i < threads; ++i)
+                rc.push_back(std::async(std::launch::async, &BuddhabrotRenderer::sampleOrbits, this, i, round, n*i/threads, n*(i+1)/threads));
+            sampleOrbits(0, round, 0, n/threads);
+            for (auto &r: rc)
+                r.get();
+            mergeHistograms();
+            paint();
+            notifyProgress();
+            done += n;
+        }
+        threadHistograms.clear();
+        iterationCount = stepCount;
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
+        return std::pair<T,T>(T(orbitCount), duration);
+    }
+
+private:
+    static const unsigned gridSize = 64;
+    static const unsigned probesPerCell = 16;
+
+    /* Orbit of c, kept in orbit; returns number of points to plot if it escaped past minIterations, 0 otherwise */
+    unsigned computeOrbit(DynamicalSystem<T> *sys, const std::complex<T> &c, std::vector<std::complex<T> > &orbit, uint64_t &steps) {
+        if (sys->isKnownInterior(c)) return 0;
+        sys->init(c);
+        /* Orbits revisiting the point saved at the last power of two step are periodic, hence bounded */
+        Complex<T> saved = sys->getVal();
+        for (unsigned i = 0; i < numIterations; ++i) {
+            Complex<T> x = orbit[i] = sys->step();
+            if (norm(x) > 4.0) {
+                steps += i + 1;
+                return i + 1 > minIterations ? i : 0;
+            }
+            if (norm(x - saved) < T(1e-20)) {
+                steps += i + 1;
+                return 0;
+            }
+            if ((i & (i + 1)) == 0)
+                saved = x;
+        }
+        steps += numIterations;
+        return 0;
+    }
+
+    /* Pixel offset of the point, or -1 if it is outside of the view */
+    long getPixel(const std::complex<T> &x) {
+        T fx = (x.real() - topleft.real())*scaleX, fy = (x.imag() - topleft.imag())*scaleY;
+        if (!(fx >= 0 && fy >= 0 && fx < surface->getWidth() && fy < surface->getHeight())) return -1;
+        return long(fy)*surface->getWidth() + long(fx);
+    }
+
+    std::complex<T> getCellOrigin(unsigned cell) {
+        return sampleTopLeft + std::complex<T>((cell % gridSize)*cellSize.real(), (cell / gridSize)*cellSize.imag());
+    }
+
+    /* Sampling density minimizing variance per unit of time is proportional to the L2 norm of what an orbit adds
+     * to the histogram, sqrt of its hits in the view, over the square root of its cost. Cells are weighted by that
+     * estimate from stratified probes, mixed half and half with uniform sampling: every cell can still be sampled,
+     * so the weighted estimate stays unbiased, and no orbit is weighted by more than 2 */
+    void buildImportanceMap(unsigned threads) {
+        TRACE_SCOPE("importanceMap");
+        scaleX = surface->getWidth()/(bottomright.real() - topleft.real());
+        scaleY = surface->getHeight()/(bottomright.imag() - topleft.imag());
+        cellSize = std::complex<T>((sampleBottomRight.real() - sampleTopLeft.real())/gridSize, (sampleBottomRight.imag() - sampleTopLeft.imag())/gridSize);
+        cumulativeWeights.clear();
+        if (!importanceSampling) return;
+        std::vector<double> weights(gridSize*gridSize);
+        std::atomic<unsigned> next(0);
+        auto probe = [this, &weights, &next] {
+            DynamicalSystem<T> *sys = factory();
+            std::vector<std::complex<T> > orbit(numIterations);
+            uint64_t steps = 0;
+            unsigned side = unsigned(std::sqrt(double(probesPerCell)));
+            for (unsigned cell = next++; cell < weights.size(); cell = next++) {
+                uint64_t cellSteps = 0;
+                double norm = 0;
+                for (unsigned p = 0; p < side*side; ++p) {
+                    auto c = getCellOrigin(cell) + std::complex<T>((p % side + T(.5))/side*cellSize.real(), (p / side + T(.5))/side*cellSize.imag());
+                    unsigned n = computeOrbit(sys, c, orbit, cellSteps), hits = 0;
+                    for (unsigned i = 0; i < n; ++i)
+                        hits += getPixel(orbit[i]) >= 0;
+                    norm += std::sqrt(double(hits));
+                }
+                weights[cell] = norm/std::sqrt(double(cellSteps + side*side));
+                steps += cellSteps;
+            }
+            delete sys;
+            stepCount += steps;
+        };
+        std::vector<std::future<void> > rc;
+        for (unsigned i = 1; i < threads; ++i)
+            rc.push_back(std::async(std::launch::async, probe));
+        probe();
+        for (auto &r: rc)
+            r.get();
+        double total = 0;
+        for (auto w: weights)
+            total += w;
+        if (total == 0) return;
+        double floor = total/weights.size();
+        cumulativeWeights.resize(weights.size());
+        total = 0;
+        for (size_t i = 0; i < weights.size(); ++i)
+            cumulativeWeights[i] = total += weights[i] + floor;
+    }
+
+    void sampleOrbits(unsigned thread, unsigned round, uint64_t first, uint64_t last) {
+        TRACE_SCOPE("sampleOrbits");
+        std::mt19937_64 rng(seed*0x9e3779b97f4a7c15ull + (uint64_t(round) << 20) + thread);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        auto &hist = threadHistograms[thread];
+        DynamicalSystem<T> *sys = factory();
+        std::vector<std::complex<T> > orbit(numIterations);
+        uint64_t steps = 0, plotted = 0;
+        double total = cumulativeWeights.empty() ? 0 : cumulativeWeights.back();
+        unsigned cells = gridSize*gridSize;
+        for (uint64_t s = first; s < last; ++s) {
+            unsigned cell;
+            double weight = 1;
+            if (cumulativeWeights.empty())
+                cell = std::min<unsigned>(cells - 1, unsigned(uniform(rng)*cells));
+            else {
+                cell = std::min<unsigned>(cells - 1, std::upper_bound(cumulativeWeights.begin(), cumulativeWeights.end(), uniform(rng)*total) - cumulativeWeights.begin());
+                /* Density relative to uniform sampling is cells*p(cell) */
+                double p = (cumulativeWeights[cell] - (cell ? cumulativeWeights[cell-1] : 0))/total;
+                weight = 1/(cells*p);
+            }
+            auto c = getCellOrigin(cell) + std::complex<T>(T(uniform(rng))*cellSize.real(), T(uniform(rng))*cellSize.imag());
+            unsigned n = computeOrbit(sys, c, orbit, steps);
+            if (n) plotted++;
+            for (unsigned i = 0; i < n; ++i) {
+                auto px = getPixel(orbit[i]);
+                if (px >= 0) hist[px] += weight;
+            }
+        }
+        delete sys;
+        stepCount += steps;
+        orbitCount += plotted;
+    }
+
+    void mergeHistograms() {
+        TRACE_SCOPE("merge");
+        for (auto &h: threadHistograms) {
+            for (size_t i = 0; i < histogram.size(); ++i)
+                histogram[i] += h[i];
+            std::fill(h.begin(), h.end(), 0);
+        }
+    }
+
+    /* Square root of density relative to the densest pixel */
+    void paint() {
+        TRACE_SCOPE("paint");
+        double peak = *std::max_element(histogram.begin(), histogram.end());
+        unsigned w = surface->getWidth();
+        std::vector<float> row(w);
+        for (unsigned y = 0; y < surface->getHeight(); ++y) {
+            for (unsigned x = 0; x < w; ++x)
+                row[x] = peak > 0 ? float(std::sqrt(histogram[size_t(y)*w+x]/peak))*.999f : 0;
+            surface->putBlock(0, y, w, 1, row.data());
+        }
+    }
+
+    uint64_t numSamples, roundSamples;
+    unsigned minIterations;
+    bool importanceSampling;
+    uint64_t seed;
+    std::complex<T> sampleTopLeft, sampleBottomRight, cellSize;
+    T scaleX, scaleY;
+    std::vector<double> histogram, cumulativeWeights;
+    std::vector<std::vector<double> > threadHistograms;
+    std::atomic<uint64_t> orbitCount, stepCount;
+
+    using AbstractRenderer<T>::topleft;
+    using AbstractRenderer<T>::bottomright;
+    using AbstractRenderer<T>::surface;
+    using AbstractRenderer<T>::numIterations;
+    using AbstractRenderer<T>::numThreads;
+    using AbstractRenderer<T>::iterationCount;
+    using AbstractRenderer<T>::factory;
+    using AbstractRenderer<T>::notifyProgress;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Complex value type with plain arithmetic for the inner loops
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_Complex_h
+#define Mandelbrot_Complex_h
+#include <complex>
+#include <cmath>
+
+/* Drop-in for std::complex in inner loops: multiplication and division are the textbook formulas, without the
+ * C99 Annex G recovery of infinite and NaN results that std::complex falls back to through a library call,
+ * and norm() is always x^2 + y^2. Converts implicitly to and from std::complex, which APIs keep using */
+template<typename T> class Complex {
+public:
+    Complex(T r = 0, T i = 0): re(r), im(i) {}
+    Complex(const std::complex<T> &z): re(z.real()), im(z.imag()) {}
+    operator std::complex<T>() const { return std::complex<T>(re, im); }
+
+    T real() const { return re; }
+    T imag() const { return im; }
+
+    Complex &operator+=(const Complex &b) { re += b.re; im += b.im; return *this; }
+    Complex &operator-=(const Complex &b) { re -= b.re; im -= b.im; return *this; }
+    Complex &operator*=(const Complex &b) { return *this = *this * b; }
+    Complex &operator/=(const Complex &b) { return *this = *this / b; }
+
+    friend Complex operator-(const Complex &a) { return Complex(-a.re, -a.im); }
+    friend Complex operator+(const Complex &a, const Complex &b) { return Complex(a.re + b.re, a.im + b.im); }
+    friend Complex operator-(const Complex &a, const Complex &b) { return Complex(a.re - b.re, a.im - b.im); }
+    friend Complex operator*(const Complex &a, const Complex &b) { return Complex(a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re); }
+    friend Complex operator*(const Complex &a, T b) { return Complex(a.re*b, a.im*b); }
+    friend Complex operator*(T a, const Complex &b) { return Complex(a*b.re, a*b.im); }
+    friend Complex operator/(const Complex &a, const Complex &b) {
+        T inv = 1/(b.re*b.re + b.im*b.im);
+        return Complex((a.re*b.re + a.im*b.im)*inv, (a.im*b.re - a.re*b.im)*inv);
+    }
+    friend Complex operator/(const Complex &a, T b) { return Complex(a.re/b, a.im/b); }
+    friend bool operator==(const Complex &a, const Complex &b) { return a.re == b.re && a.im == b.im; }
+    friend bool operator!=(const Complex &a, const Complex &b) { return !(a == b); }
+
+private:
+    T re, im;
+};
+
+template<typename T> inline T norm(const Complex<T> &z) { return z.real()*z.real() + z.imag()*z.imag(); }
+template<typename T> inline T abs(const Complex<T> &z) { return std::sqrt(norm(z)); }
+template<typename T> inline Complex<T> conj(const Complex<T> &z) { return Complex<T>(z.real(), -z.imag()); }
+
+#endif
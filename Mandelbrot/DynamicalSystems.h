@@ -0,0 +1,206 @@
+/*
+ * Dynamical systems explored by the renderers
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Mandelbrot__DynamicalSystems__
+#define __Mandelbrot__DynamicalSystems__
+#include <complex>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include "AbstractRenderer.h"
+#include "Polynomial.h"
+#include "Complex.h"
+
+template<typename T> Polynomial<T> buildMisiurewiczPolynomial(unsigned k, unsigned n) {
+    Polynomial<T> c(0);
+    for(auto i(0);i<k;++i)
+        c = c*c + Polynomial<T>::x;
+    auto pk = c;
+    for (auto i(0); i<n;++i)
+        c = c*c + Polynomial<T>::x;
+    return c-pk;
+}
+
+
+template<typename T> class PolynomialDynamicalSystem: public DynamicalSystem<T> {
+public:
+    PolynomialDynamicalSystem(): x(0,0), c(0,0) {}
+    PolynomialDynamicalSystem(std::complex<T> _c): x(0,0), c(_c) {}
+    PolynomialDynamicalSystem(T re, T im): x(0,0), c(re,im) {}
+
+    std::complex<T> step() {
+        return x = x*x + c;
+    }
+    std::complex<T> getVal() { return x; }
+    /* Constant added at every step, lets renderers run x = x^2 + c without virtual calls */
+    std::complex<T> getParam() { return c; }
+protected:
+    /* Stays on std::complex: x^2 + c has no division, and Complex state measured slower for Julia sets (mandel-bench complex) */
+    std::complex<T> x,c;
+};
+
+template<typename T> class Mandelbrot:  public PolynomialDynamicalSystem<T> {
+    using PolynomialDynamicalSystem<T>::c;
+    using PolynomialDynamicalSystem<T>::x;
+
+public:
+    void init(std::complex<T> _c) {
+        c = _c;
+        x = 0;
+    }
+    unsigned getSymmetry() { return ConjugateSymmetry; }
+    /* Main cardioid and period 2 bulb */
+    bool isKnownInterior(const std::complex<T> &p) {
+        T re = p.real() - T(.25), im2 = p.imag()*p.imag();
+        T q = re*re + im2;
+        if (q*(q + re) <= T(.25)*im2) return true;
+        re = p.real() + 1;
+        return re*re + im2 <= T(1./16);
+    }
+};
+
+template<typename T> class Julia:  public PolynomialDynamicalSystem<T> {
+    using PolynomialDynamicalSystem<T>::c;
+    using PolynomialDynamicalSystem<T>::x;
+public:
+    Julia(T re, T im): PolynomialDynamicalSystem<T>(re,im) {}
+    void init(std::complex<T> _x) { x = _x; }
+    /* (-x)^2 = x^2, and real c commutes with conjugation */
+    unsigned getSymmetry() { return PointSymmetry | (c.imag() == 0 ? ConjugateSymmetry : 0); }
+
+    /* An attracting cycle, if there is one, attracts the critical orbit of 0. Once that has settled at w_0,
+     * points within d_0 of w_0 stay within d_{k+1} = d_k*(2|w_k| + d_k) of its orbit w_k, so a disk of
+     * radius r around w_0 is mapped into itself by f^p when |w_p - w_0| + d_p <= r for d_0 = r */
+    InteriorTrap<T> getInteriorTrap(unsigned maxIter) {
+        const unsigned maxPeriod = 256;
+        InteriorTrap<T> rc;
+        std::complex<T> z(0, 0);
+        for (unsigned i = 0; i < maxIter; ++i)
+            if (norm(z = z*z + c) > 4) return rc;
+        std::vector<T> moduli;
+        auto w = z;
+        for (unsigned p = 1; p <= maxPeriod; ++p) {
+            moduli.push_back(std::abs(w));
+            w = w*w + c;
+            T gap = std::abs(w - z);
+            /* Margin covers rounding of the orbits iterated by the renderer */
+            for (T r = .5; r > gap && r > 64*std::numeric_limits<T>::epsilon(); r /= 2) {
+                T d = r;
+                for (auto m: moduli)
+                    d *= 2*m + d;
+                if (gap + d <= T(.9)*r) {
+                    rc.center = z;
+                    rc.radius = r;
+                    rc.period = p;
+                    return rc;
+                }
+            }
+        }
+        return rc;
+    }
+};
+
+template<typename T> class Newton:public DynamicalSystem<T> {
+public:
+    Newton(const Polynomial<T> &p): poly(p), derPoly(p.derivative()), x(0,0) {}
+    std::complex<T> step() {
+        return x -= poly(x)/derPoly(x);
+    }
+    std::complex<T> getVal() { return x;}
+    void init(std::complex<T> x0) {x = x0;}
+    /* Newton map of a real polynomial commutes with conjugation, of an odd or even one with negation */
+    unsigned getSymmetry() {
+        bool real = true, odd = true, even = true;
+        for (unsigned i = 0; i <= poly.degree(); ++i) {
+            if (std::imag(poly[i]) != 0) real = false;
+            if (poly[i] != T(0)) (i % 2 ? even : odd) = false;
+        }
+        return (real ? ConjugateSymmetry : 0) | (odd || even ? PointSymmetry : 0);
+    }
+
+private:
+    Polynomial<T> poly, derPoly;
+    Complex<T> x;
+};
+
+/* x^N by repeated squaring, unrolled at compile time */
+template<unsigned N> struct IntegerPower {
+    template<typename C> static C apply(const C &x) {
+        auto h = IntegerPower<N/2>::apply(x);
+        return N % 2 ? h*h*x : h*h;
+    }
+};
+
+template<> struct IntegerPower<1> {
+    template<typename C> static C apply(const C &x) { return x; }
+};
+
+/* x^p for fixed p, on the principal branch like std::pow: multiplications for integer p up to 8,
+ * otherwise polar form with one atan2, one real pow of the squared modulus and one sincos
+ * instead of the complex log and exp std::pow goes through */
+template<typename T, typename C = Complex<T> > class ComplexPower {
+public:
+    ComplexPower(T _p): p(_p), func(polar) {
+        static const Func integer[] = { unrolled<1>, unrolled<2>, unrolled<3>, unrolled<4>, unrolled<5>, unrolled<6>, unrolled<7>, unrolled<8> };
+        if (p >= 1 && p <= 8 && p == std::floor(p))
+            func = integer[unsigned(p)-1];
+    }
+    C operator()(const C &x) const { return func(x, p); }
+    bool isInteger() const { return func != polar; }
+
+private:
+    typedef C (*Func)(const C &, T);
+    template<unsigned N> static C unrolled(const C &x, T) { return IntegerPower<N>::apply(x); }
+    static C polar(const C &x, T p) {
+        T r2 = norm(x);
+        if (r2 == 0) return 0;
+        T phi = p*std::atan2(x.imag(), x.real()), r = std::pow(r2, p/2);
+        return C(r*std::cos(phi), r*std::sin(phi));
+    }
+
+    T p;
+    Func func;
+};
+
+template<typename T> class Multibrot: public DynamicalSystem<T> {
+public:
+    Multibrot(T _p):x(0,0),c(0,0),p(_p),power(_p) {}
+
+    void init(std::complex<T> _c) { c = _c; x = 0; }
+
+    std::complex<T> step() {
+        return x = power(x) + c;
+
+    }
+    std::complex<T> getVal() { return x; }
+    /* Odd integer powers commute with negation too */
+    unsigned getSymmetry() { return ConjugateSymmetry | (p == std::floor(p) && std::fmod(p, T(2)) == 1 ? PointSymmetry : 0); }
+private:
+    Complex<T> x,c;
+    T p;
+    ComplexPower<T> power;
+};
+
+#endif /* defined(__Mandelbrot__DynamicalSystems__) */
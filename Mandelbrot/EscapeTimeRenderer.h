@@ -26,100 +26,404 @@
 #ifndef __Mandelbrot__EscapeTimeRenderer__
 #define __Mandelbrot__EscapeTimeRenderer__
 #include "AbstractRenderer.h"
+#include "Complex.h"
 #include <functional>
 #include <chrono>
 #include <future>
+#include <thread>
 #include <complex>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <sstream>
+#include <limits>
 #include "OffsceenSurface.h"
+#include "RenderCheckpoint.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include "RenderProfile.h"
+#include "DynamicalSystems.h"
+#include "Kernels.h"
 
 template<typename T> class EscapeTimeRenderer: public AbstractRenderer<T> {
 public:
-    EscapeTimeRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): AbstractRenderer<T>(s,f) {}
+    EscapeTimeRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): AbstractRenderer<T>(s,f), checkpoint(nullptr), stats(nullptr) {
+        setProfile(RenderProfile());
+    }
+    /* Tile size, thread count and kernel choice from p, e.g. the host profile RenderProfile::getDefault() */
+    void setProfile(const RenderProfile &p) {
+        tileSize = p.tileSize;
+        numThreads = p.threads;
+        specializedKernel = p.specializedKernel;
+    }
+    /* Render in size*size tiles instead of 16 sections, 0 restores the default */
+    void setTileSize(unsigned size) { tileSize = size; }
+    /* Collect per-tile counters of every render into s, nullptr disables collection */
+    void setStats(RenderStats *s) { stats = s; }
+    /* Iterate x = x^2 + c systems with the dispatched SIMD kernels instead of through virtual step(),
+     * results are bit-identical; on by default */
+    void setSpecializedKernel(bool on) { specializedKernel = on; }
+    /* Log completed tiles to checkpoint and resume from it, tag identifies the dynamical system */
+    void setCheckpoint(RenderCheckpoint *c, const std::string &tag = "") { checkpoint = c; checkpointTag = tag; }
 
     float computeEscapeTime(DynamicalSystem<T> *sys, const std::complex<T> &c) {
+        unsigned steps;
+        return computeEscapeTime(sys, c, steps);
+    }
+
+    /* Same as above, also reporting number of steps taken */
+    float computeEscapeTime(DynamicalSystem<T> *sys, const std::complex<T> &c, unsigned &steps) {
         sys->init(c);
-        for (unsigned steps(0); steps < numIterations; ++steps) {
-            auto x = sys->step();
+        T trapRadius2 = trap.radius*trap.radius;
+        for (steps = 0; steps < numIterations; ++steps) {
+            Complex<T> x = sys->step();
             if (norm(x) > 4.0) {
-                if (steps == 0) return 0;
-                return steps + 1 - (log (log (norm(x)))/log(2));
+                if (steps++ == 0) return 0;
+                return smoothEscapeTime(steps, norm(x));
+            }
+            if (trapRadius2 > 0 && norm(x - trap.center) < trapRadius2) {
+                steps++;
+                break;
             }
         }
         return numIterations;
 
     }
 
-private:
+    /* Same as above for a row of x = x^2 + c orbits, iterated side by side by the vectorized kernel */
+    void computeQuadraticEscapeTimes(PolynomialDynamicalSystem<T> *sys, unsigned y, unsigned sx, unsigned ex,
+                                     std::complex<T> stepx, std::complex<T> stepy, float *out, unsigned *steps) {
+        unsigned n = ex - sx;
+        std::vector<T> xr(n), xi(n), cr(n), ci(n), norms(n);
+        for (unsigned i = 0; i < n; ++i) {
+            sys->init(topleft + ((T)y)*stepy + ((T)(sx+i))*stepx);
+            auto x = sys->getVal(), c = sys->getParam();
+            xr[i] = x.real();
+            xi[i] = x.imag();
+            cr[i] = c.real();
+            ci[i] = c.imag();
+        }
+        T trapDisk[] = { trap.center.real(), trap.center.imag(), trap.radius*trap.radius };
+        quadraticEscape(xr.data(), xi.data(), cr.data(), ci.data(), n, numIterations, trap.radius > 0 ? trapDisk : nullptr, steps, norms.data());
+        for (unsigned i = 0; i < n; ++i) {
+            if (steps[i] == 0 || norms[i] == 0) {
+                steps[i] = steps[i] == 0 ? numIterations : steps[i];
+                out[i] = numIterations;
+            } else
+                out[i] = steps[i] == 1 ? 0 : smoothEscapeTime(steps[i], norms[i]);
+        }
+    }
+
+protected:
+    /* Fractional escape time, orbits of high powers overshoot so far that it would drop below 0 */
+    static float smoothEscapeTime(unsigned steps, T norm2) {
+        float rc = steps - (log (log (norm2))/log(2));
+        return rc > 0 ? rc : 0;
+    }
+
     using AbstractRenderer<T>::numIterations;
+    using AbstractRenderer<T>::numThreads;
     using AbstractRenderer<T>::factory;
     using AbstractRenderer<T>::surface;
     using AbstractRenderer<T>::topleft;
     using AbstractRenderer<T>::bottomright;
+    using AbstractRenderer<T>::notifyProgress;
+    using AbstractRenderer<T>::iterationCount;
+    using AbstractRenderer<T>::getSymmetryMap;
+    using AbstractRenderer<T>::antialiasSamples;
+    using AbstractRenderer<T>::antialiasThreshold;
+    using AbstractRenderer<T>::findEdgePixels;
+    using AbstractRenderer<T>::getSubpixelPoint;
+    using AbstractRenderer<T>::escapeHistogram;
+    using AbstractRenderer<T>::histogramPixels;
 
 private:
-    T renderSection(unsigned sx, unsigned sy, unsigned ex, unsigned ey) {
+    /* Render section into surface, counting escape steps into histogram and keeping palette values in block when given */
+    T renderSection(unsigned sx, unsigned sy, unsigned ex, unsigned ey, TileStats &tile, uint64_t *histogram, std::vector<float> *block = nullptr) {
+        TRACE_SCOPE("section");
         auto w = surface->getWidth();
         auto h = surface->getHeight();
         std::complex<T> stepx((bottomright.real()-topleft.real())/w,0);
         std::complex<T> stepy(0, (bottomright.imag()-topleft.imag())/h);
         float invIterations = 1.f/numIterations;
         DynamicalSystem<T> *sys = factory();
+        auto quadratic = specializedKernel ? dynamic_cast<PolynomialDynamicalSystem<T> *>(sys) : nullptr;
         auto pixelArea = stepx.real()*stepy.imag();
         T rc = 0;
-        for(unsigned y(sy);y<ey; ++y)
+        std::vector<float> buf, times(ex-sx);
+        std::vector<unsigned> steps(ex-sx);
+        std::vector<char> mirrored(ex-sx);
+        if (!block) block = &buf;
+        block->resize(size_t(ex-sx)*(block == &buf ? 1 : ey-sy));
+        for(unsigned y(sy);y<ey; ++y) {
+            float *row = block == &buf ? buf.data() : block->data() + size_t(y-sy)*(ex-sx);
+            /* Render runs of pixels in between the mirrored ones, those are filled in by mirrorPixels() */
+            for (unsigned x0(sx); x0 < ex;) {
+                unsigned x1 = x0;
+                while (x1 < ex && !symmetry.isMirrored(x1, y)) ++x1;
+                if (quadratic && x1 > x0)
+                    computeQuadraticEscapeTimes(quadratic, y, x0, x1, stepx, stepy, times.data()+(x0-sx), steps.data()+(x0-sx));
+                else if (x1 > x0)
+                    for(unsigned x(x0); x<x1; ++x)
+                        times[x-sx] = computeEscapeTime(sys, topleft + ((T)y)*stepy + ((T)x)*stepx, steps[x-sx]);
+                std::fill(mirrored.begin()+(x0-sx), mirrored.begin()+(x1-sx), 0);
+                for (x0 = x1; x0 < ex && symmetry.isMirrored(x0, y); ++x0)
+                    mirrored[x0-sx] = 1;
+            }
             for(unsigned x(sx); x<ex; ++x) {
-                float c = computeEscapeTime(sys, topleft + ((T)y)*stepy + ((T)x)*stepx);
+                if (mirrored[x-sx]) {
+                    row[x-sx] = 0;
+                    continue;
+                }
+                float c = times[x-sx];
+                /* Counters describe the whole view, so a rendered pixel also counts for its mirror images */
+                unsigned weight = symmetry.getWeight(x, y);
+                tile.computedIterations += steps[x-sx];
+                tile.iterations += uint64_t(steps[x-sx])*weight;
                 if (c >= numIterations) {
-                    rc += pixelArea;
-                    surface->putPixel(x, y, 0, 0, 0);
+                    /* Trapped orbits and known interior points are decided regardless of the cap */
+                    if (steps[x-sx] >= numIterations && !sys->isKnownInterior(topleft + ((T)y)*stepy + ((T)x)*stepx))
+                        histogram[numIterations] += weight;
+                    rc += pixelArea*weight;
+                    row[x-sx] = -1;
+                    tile.capped += weight;
                     continue;
                 }
-                surface->putPixel(x, y, c*invIterations);
+                histogram[steps[x-sx]-1] += weight;
+                tile.escaped += weight;
+                row[x-sx] = c*invIterations;
             }
+            surface->putBlock(sx, y, ex-sx, 1, row);
+            if (!values.empty())
+                std::copy(row, row + (ex-sx), values.begin() + size_t(y)*w + sx);
+            notifyProgress();
+        }
         delete sys;
         return rc;
     }
 
+    /* Supersample pixels on edges between palette values of the render, cost grows with the length of the edges */
+    void antialias(unsigned threads) {
+        TRACE_SCOPE("antialias");
+        auto edges = findEdgePixels([this](size_t a, size_t b) {
+            return (values[a] < 0) != (values[b] < 0) || std::fabs(values[a] - values[b]) > antialiasThreshold;
+        });
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> steps(0);
+        auto work = [this, &edges, &next, &steps] {
+            const size_t chunk = 64;
+            DynamicalSystem<T> *sys = factory();
+            std::vector<float> samples(antialiasSamples);
+            float invIterations = 1.f/numIterations;
+            unsigned w = surface->getWidth();
+            uint64_t n = 0;
+            for (size_t i = next.fetch_add(chunk); i < edges.size(); i = next.fetch_add(chunk))
+                for (size_t j = i; j < std::min(edges.size(), i + chunk); ++j) {
+                    unsigned x = edges[j] % w, y = edges[j] / w, s;
+                    for (unsigned k = 0; k < antialiasSamples; ++k) {
+                        float t = computeEscapeTime(sys, getSubpixelPoint(x, y, k), s);
+                        samples[k] = t >= numIterations ? -1 : t*invIterations;
+                        n += s;
+                    }
+                    surface->putSamples(x, y, samples.data(), antialiasSamples);
+                }
+            delete sys;
+            steps += n;
+        };
+        std::vector<std::future<void> > rc;
+        for (unsigned i(1); i < threads; ++i)
+            rc.push_back(std::async(std::launch::async, work));
+        work();
+        for (auto &res: rc)
+            res.get();
+        iterationCount += steps;
+        notifyProgress();
+    }
+
+protected:
+    /* Look for a trap once per render, orbits entering it count as not escaping right away */
+    void updateTrap() {
+        TRACE_SCOPE("findTrap");
+        DynamicalSystem<T> *sys = factory();
+        trap = sys->getInteriorTrap(numIterations);
+        delete sys;
+    }
+
+private:
+    /* Copy pixels mirrored by symmetry from their rendered counterparts, in row-major order as sources precede them */
+    void mirrorPixels() {
+        TRACE_SCOPE("mirror");
+        unsigned sx, sy;
+        for (unsigned y(0); y < surface->getHeight(); ++y)
+            for (unsigned x(0); x < surface->getWidth(); ++x)
+                if (symmetry.getSource(x, y, sx, sy) != SymmetryMap::Identity) {
+                    surface->copyPixel(sx, sy, x, y);
+                    if (!values.empty())
+                        values[size_t(y)*surface->getWidth() + x] = values[size_t(sy)*surface->getWidth() + sx];
+                }
+        notifyProgress();
+    }
+
     typedef std::pair<unsigned,unsigned> point;
 
     point make_point(unsigned x, unsigned y) {return std::pair<unsigned,unsigned>(x,y);}
 
-    /* Partition area into (numSection+1)*(numSection+1) equally sized squares */
+    /* Partition area into (numSection+1)*(numSection+1) squares aligned to surface tiles, spreading whole tiles
+     * evenly among them, so that no row or column is left with the remainder */
     std::vector<std::pair<point, point> > partitionArea(unsigned numSections=1) {
         unsigned width = surface->getWidth();
         unsigned height = surface->getHeight();
-        unsigned stepW = width/(numSections+1);
-        unsigned stepH = height/(numSections+1);
+        unsigned align = surface->getAlignment();
+        auto bound = [align, numSections](unsigned i, unsigned size) {
+            unsigned units = (size + align - 1)/align;
+            return std::min(size, align*unsigned((uint64_t(2*i)*units + numSections + 1)/(2*(numSections + 1))));
+        };
         std::vector<std::pair<point, point> > rc;
         for (unsigned x(0); x<numSections+1;++x)
             for(unsigned y(0); y<numSections+1;++y) {
-                auto tl = make_point(x*stepW,y*stepH);
-                auto br = make_point(x==numSections ? width : (x+1)*stepW, y == numSections? height : (y+1)*stepH);
+                auto tl = make_point(bound(x, width), bound(y, height));
+                auto br = make_point(bound(x+1, width), bound(y+1, height));
+                if (tl.first >= br.first || tl.second >= br.second) continue;
                 rc.push_back(std::pair<point,point>(tl,br));
             }
         return rc;
     }
 
-    std::future<T> renderAsync(point tl, point br) {
-        std::future<T> rc(std::async(std::launch::async, &EscapeTimeRenderer::renderSection, this, tl.first, tl.second, br.first, br.second));
+    /* Row-major grid of size*size tiles, rounded up to surface alignment */
+    std::vector<std::pair<point, point> > partitionTiles(unsigned size) {
+        unsigned width = surface->getWidth();
+        unsigned height = surface->getHeight();
+        unsigned align = surface->getAlignment();
+        size = std::max(1u, (size + align - 1)/align*align);
+        std::vector<std::pair<point, point> > rc;
+        for (unsigned y(0); y < height; y += size)
+            for (unsigned x(0); x < width; x += size)
+                rc.push_back(std::pair<point,point>(make_point(x, y), make_point(std::min(width, x+size), std::min(height, y+size))));
         return rc;
     }
 
+    /* Everything the stored palette values depend on, except for the dynamical system itself */
+    std::string checkpointKey() {
+        std::ostringstream ss;
+        ss.precision(std::numeric_limits<T>::max_digits10);
+        ss<<"escape-time "<<checkpointTag<<" "<<sizeof(T)<<" "<<topleft<<" "<<bottomright<<" "<<numIterations
+          <<" "<<surface->getWidth()<<"x"<<surface->getHeight()<<" "<<checkpoint->getTileSize()
+          <<(symmetry.isEmpty() ? "" : " mirrored");
+        return ss.str();
+    }
+
+    typedef std::vector<std::pair<point, point> > sectionList;
+
+    /* Render sections picked from the shared list by worker thread until it is exhausted */
+    void renderSections(const sectionList *sections, std::vector<T> *areas, std::vector<TileStats> *tiles, std::atomic<unsigned> *next,
+                        std::vector<uint64_t> *histogram, unsigned thread, std::chrono::steady_clock::time_point start) {
+        typedef std::chrono::duration<double, std::milli> msec;
+        std::vector<float> block;
+        histogram->assign(numIterations+1, 0);
+        for (unsigned i = (*next)++; i < sections->size(); i = (*next)++) {
+            auto &reg = (*sections)[i];
+            if (checkpoint && checkpoint->isDone(i)) continue;
+            auto &tile = (*tiles)[i];
+            auto tileStart = std::chrono::steady_clock::now();
+            tile.x = reg.first.first;
+            tile.y = reg.first.second;
+            tile.w = reg.second.first - reg.first.first;
+            tile.h = reg.second.second - reg.first.second;
+            tile.thread = thread;
+            tile.startMs = msec(tileStart - start).count();
+            (*areas)[i] = renderSection(reg.first.first, reg.first.second, reg.second.first, reg.second.second, tile, histogram->data(), checkpoint ? &block : nullptr);
+            if (checkpoint)
+                checkpoint->save(i, block.data(), block.size(), (*areas)[i]);
+            tile.wallMs = msec(std::chrono::steady_clock::now() - tileStart).count();
+        }
+    }
+
+    /* Paint tiles restored from checkpoint */
+    void restoreSections(const sectionList &sections, std::vector<T> *areas) {
+        for (unsigned i = 0; i < sections.size(); ++i) {
+            if (!checkpoint->isDone(i)) continue;
+            auto &reg = sections[i];
+            unsigned w = reg.second.first - reg.first.first, h = reg.second.second - reg.first.second;
+            if (checkpoint->getValues(i).size() != size_t(w)*h) {
+                checkpoint->discard(i);
+                continue;
+            }
+            surface->putBlock(reg.first.first, reg.first.second, w, h, checkpoint->getValues(i).data());
+            for (unsigned y = 0; y < h && !values.empty(); ++y)
+                std::copy_n(checkpoint->getValues(i).begin() + size_t(y)*w, w, values.begin() + size_t(reg.first.second + y)*surface->getWidth() + reg.first.first);
+            (*areas)[i] = checkpoint->getArea(i);
+        }
+        checkpoint->releaseValues();
+        notifyProgress();
+    }
+
+    unsigned tileSize;
+    bool specializedKernel;
+    RenderCheckpoint *checkpoint;
+    std::string checkpointTag;
+    RenderStats *stats;
+    SymmetryMap symmetry;
+    InteriorTrap<T> trap;
+    /* Palette values of the whole surface, kept while antialiasing */
+    std::vector<float> values;
+
 public:
     /*Return area and time in milliseconds */
     std::pair<T,T> render(void) {
+        TRACE_SCOPE("render");
 
         auto start = std::chrono::steady_clock::now();
 
-        std::vector<std::future<T> > rc;
-        for(auto& reg: partitionArea(3))
-            rc.push_back(renderAsync(reg.first, reg.second));
+        symmetry = getSymmetryMap();
+        updateTrap();
+        auto sections = checkpoint ? partitionTiles(checkpoint->getTileSize()) : tileSize ? partitionTiles(tileSize) : partitionArea(3);
+        std::vector<T> areas(sections.size());
+        std::vector<TileStats> tiles(sections.size());
+        values.assign(antialiasSamples > 1 ? size_t(surface->getWidth())*surface->getHeight() : 0, 0);
+        if (checkpoint && checkpoint->begin(checkpointKey(), sections.size()) > 0)
+            restoreSections(sections, &areas);
+        std::atomic<unsigned> next(0);
+        std::vector<std::vector<uint64_t> > histograms(sections.size());
+        unsigned defaultThreads = checkpoint || tileSize ? std::max(1u, std::thread::hardware_concurrency()) : sections.size();
+        unsigned threads = std::min<unsigned>(numThreads == 0 ? defaultThreads : numThreads, sections.size());
+        std::vector<std::future<void> > rc;
+        for (unsigned i(1); i < threads; ++i)
+            rc.push_back(std::async(std::launch::async, &EscapeTimeRenderer::renderSections, this, &sections, &areas, &tiles, &next, &histograms[i], i, start));
+        renderSections(&sections, &areas, &tiles, &next, &histograms[0], 0, start);
+        for (auto &res: rc)
+            res.get();
+        if (!symmetry.isEmpty())
+            mirrorPixels();
+        iterationCount = 0;
+        histogramPixels = 0;
+        for (auto &t: tiles) {
+            iterationCount += t.computedIterations;
+            histogramPixels += t.escaped + t.capped;
+        }
+        escapeHistogram.assign(numIterations+1, 0);
+        for (auto &h: histograms)
+            for (size_t i = 0; i < h.size(); ++i)
+                escapeHistogram[i] += h[i];
+        if (!values.empty()) {
+            antialias(std::max(1u, threads));
+            std::vector<float>().swap(values);
+        }
 
+        /* Sum in section order, so that the result does not depend on scheduling */
         T area = 0;
-        for (auto &res: rc)
-            area += res.get();
+        for (auto a: areas)
+            area += a;
         auto stop = std::chrono::steady_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop-start).count();
+        if (stats) {
+            stats->width = surface->getWidth();
+            stats->height = surface->getHeight();
+            stats->iterationCap = numIterations;
+            stats->totalMs = std::chrono::duration<double, std::milli>(stop-start).count();
+            stats->tiles.clear();
+            for (auto &t: tiles)
+                if (t.w > 0) stats->tiles.push_back(t);
+        }
         return std::pair<T,T>(area, duration);
     }
 };
@@ -0,0 +1,157 @@
+/*
+ * Exponential map zoom renderer template
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Mandelbrot__ExpMapRenderer__
+#define __Mandelbrot__ExpMapRenderer__
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include "EscapeTimeRenderer.h"
+#include "Trace.h"
+
+/* Zoom video renderer: a single log-polar (exponential map) strip of escape times
+ * covering the whole zoom path is rendered once, and every frame is resampled from it.
+ * Strip row j holds the circle of radius rmax*exp(-j*du) around the zoom center,
+ * sampled at the same angular step du, so that samples are square in every frame */
+template<typename T> class ExpMapRenderer: public EscapeTimeRenderer<T> {
+public:
+    ExpMapRenderer(OffscreenSurface *s, std::function<DynamicalSystem<T> *()> f): EscapeTimeRenderer<T>(s,f), centerRadius(0) {
+        setZoom(std::complex<T>(0, 0), 2, 2);
+    }
+
+    /* Zoom from view with half-width startRadius around center into one of half-width endRadius */
+    void setZoom(std::complex<T> c, T startRadius, T endRadius) { center = c; radius0 = startRadius; radius1 = endRadius; }
+    /* Pixels closer than this to the center of the frame are rendered at full detail instead of being resampled */
+    void setCenterRadius(unsigned px) { centerRadius = px; }
+    size_t getStripSize() { return strip.size(); }
+
+    /* Return time in milliseconds */
+    T renderStrip(unsigned frameWidth, unsigned frameHeight, unsigned numFrames) {
+        TRACE_SCOPE("renderStrip");
+        auto start = std::chrono::steady_clock::now();
+        width = frameWidth;
+        height = frameHeight;
+        frames = std::max(numFrames, 2u);
+        /* Angular resolution keeps samples at most one pixel apart at the corners of every frame */
+        T halfDiagonal = std::sqrt(T(width)*width+T(height)*height)/2;
+        columns = unsigned(std::ceil(2*M_PI*halfDiagonal));
+        du = 2*M_PI/columns;
+        T first = getPixelSize(0), last = getPixelSize(frames-1);
+        rmax = halfDiagonal*std::max(first, last);
+        rmin = std::max<T>(centerRadius, .5)*std::min(first, last);
+        rows = unsigned(std::ceil(std::log(rmax/rmin)/du))+2;
+        strip.assign(size_t(rows)*columns, 0);
+        updateTrap();
+
+        std::atomic<unsigned> next(0);
+        runParallel([this, &next] {
+            DynamicalSystem<T> *sys = factory();
+            for (unsigned j = next++; j < rows; j = next++) {
+                T r = rmax*std::exp(-T(j)*du);
+                for (unsigned i = 0; i < columns; ++i) {
+                    T phi = du*i;
+                    strip[size_t(j)*columns+i] = getValue(sys, center + std::polar(r, phi));
+                }
+            }
+            delete sys;
+        });
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(stop-start).count();
+    }
+
+    /* Resample frame of the path rendered by renderStrip into the surface */
+    void renderFrame(OffscreenSurface *s, unsigned frame) {
+        TRACE_SCOPE("resampleFrame");
+        T pixelSize = getPixelSize(frame);
+        DynamicalSystem<T> *sys = factory();
+        std::vector<float> row(width);
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                std::complex<T> d((T(x)+.5-width/2.)*pixelSize, (T(y)+.5-height/2.)*pixelSize);
+                T r = std::abs(d);
+                T u = std::log(rmax/std::max(r, rmin))/du;
+                if (r < rmin || u < 0 || u >= rows-1)
+                    row[x] = getValue(sys, center + d);
+                else
+                    row[x] = sample(u, (std::arg(d) < 0 ? std::arg(d) + 2*M_PI : std::arg(d))/du);
+            }
+            s->putBlock(0, y, width, 1, row.data());
+        }
+        delete sys;
+    }
+
+private:
+    using AbstractRenderer<T>::numIterations;
+    using AbstractRenderer<T>::numThreads;
+    using AbstractRenderer<T>::factory;
+    using EscapeTimeRenderer<T>::computeEscapeTime;
+    using EscapeTimeRenderer<T>::updateTrap;
+
+    T getPixelSize(unsigned frame) {
+        return 2*radius0*std::pow(radius1/radius0, T(frame)/(frames-1))/width;
+    }
+
+    /* Palette value, or -1 for points that did not escape */
+    float getValue(DynamicalSystem<T> *sys, std::complex<T> c) {
+        float v = computeEscapeTime(sys, c);
+        return v >= numIterations ? -1 : v/numIterations;
+    }
+
+    /* Bilinear interpolation, falling back to the nearest sample next to the set, so that interior stays black */
+    float sample(T u, T v) {
+        unsigned j = unsigned(u), i = unsigned(v) % columns, i1 = (i+1) % columns;
+        T fu = u - j, fv = v - std::floor(v);
+        float s00 = strip[size_t(j)*columns+i], s01 = strip[size_t(j)*columns+i1];
+        float s10 = strip[size_t(j+1)*columns+i], s11 = strip[size_t(j+1)*columns+i1];
+        if (s00 < 0 || s01 < 0 || s10 < 0 || s11 < 0) {
+            float s0 = fv < .5 ? s00 : s01, s1 = fv < .5 ? s10 : s11;
+            return fu < .5 ? s0 : s1;
+        }
+        return (1-fu)*((1-fv)*s00+fv*s01) + fu*((1-fv)*s10+fv*s11);
+    }
+
+    void runParallel(std::function<void()> f) {
+        unsigned threads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::future<void> > rc;
+        for (unsigned i = 1; i < threads; ++i)
+            rc.push_back(std::async(std::launch::async, f));
+        f();
+        for (auto &r: rc)
+            r.get();
+    }
+
+    std::complex<T> center;
+    T radius0, radius1;
+    unsigned centerRadius;
+    unsigned width, height, frames;
+    unsigned rows, columns;
+    T du, rmax, rmin;
+    std::vector<float> strip;
+};
+
+#endif /* defined(__Mandelbrot__ExpMapRenderer__) */
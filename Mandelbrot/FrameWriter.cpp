@@ -0,0 +1,142 @@
+/*
+ * Raw video frame writers
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FrameWriter.h"
+#include "Trace.h"
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+
+FrameWriter::FrameWriter(const std::string &path)
+{
+    out = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (out == NULL)
+        throw std::runtime_error("Can not open " + path + ": " + strerror(errno));
+}
+
+FrameWriter::~FrameWriter()
+{
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+}
+
+FrameWriter *FrameWriter::create(const std::string &format, const std::string &path)
+{
+    if (format == "ppm") return new PPMWriter(path);
+    if (format == "y4m") return new Y4MWriter(path);
+    return NULL;
+}
+
+void FrameWriter::writeData(const void *data, size_t size)
+{
+    if (fwrite(data, 1, size, out) != size)
+        throw std::runtime_error(std::string("Frame write failed: ") + strerror(errno));
+}
+
+void PPMWriter::write(OffscreenSurface *s)
+{
+    TRACE_SCOPE("writePPM");
+    char header[64];
+    int len = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", s->getWidth(), s->getHeight());
+    writeData(header, len);
+    writeData(s->getRGBData(), size_t(s->getWidth())*s->getHeight()*3);
+}
+
+/* Fixed point BT.601 coefficients scaled by 256; loops below are kept free of
+ * branches and cross-iteration dependencies so that they are vectorized at -O3.
+ * De-interleaving packed RGB needs byte shuffles, which baseline x86-64 (SSE2)
+ * lacks, so with GCC on ELF targets extra SSSE3 and AVX2 clones are selected at load time */
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__APPLE__) && (defined(__x86_64__) || defined(__i386__))
+#define VECTOR_CLONES __attribute__((target_clones("avx2","ssse3","default")))
+#else
+#define VECTOR_CLONES
+#endif
+
+VECTOR_CLONES static void convertRowY(const unsigned char *__restrict rgb, unsigned char *__restrict y, size_t width)
+{
+    for (size_t i = 0; i < width; ++i) {
+        int r = rgb[3*i], g = rgb[3*i+1], b = rgb[3*i+2];
+        y[i] = (unsigned char)(16 + ((66*r + 129*g + 25*b + 128) >> 8));
+    }
+}
+
+/* Chroma of vertically summed pixel pairs, still at full horizontal resolution */
+VECTOR_CLONES static void convertRowsUV(const unsigned char *__restrict rgb0, const unsigned char *__restrict rgb1,
+                                        int *__restrict u, int *__restrict v, size_t width)
+{
+    for (size_t i = 0; i < width; ++i) {
+        int r = rgb0[3*i] + rgb1[3*i];
+        int g = rgb0[3*i+1] + rgb1[3*i+1];
+        int b = rgb0[3*i+2] + rgb1[3*i+2];
+        u[i] = -38*r - 74*g + 112*b;
+        v[i] = 112*r - 94*g - 18*b;
+    }
+}
+
+/* Sums of four samples, hence extra 2 bits of shift */
+VECTOR_CLONES static void subsampleRow(const int *__restrict in, unsigned char *__restrict out, size_t cwidth)
+{
+    for (size_t i = 0; i < cwidth; ++i)
+        out[i] = (unsigned char)(128 + ((in[2*i] + in[2*i+1] + 512) >> 10));
+}
+
+void Y4MWriter::convertToYUV420(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *y, unsigned char *u, unsigned char *v)
+{
+    unsigned cwidth = (width+1)/2, cheight = (height+1)/2;
+    /* Odd widths replicate the last column, so that every chroma sample has four source pixels */
+    std::vector<int> usum(2*cwidth), vsum(2*cwidth);
+    for (unsigned j = 0; j < height; ++j)
+        convertRowY(rgb + size_t(j)*width*3, y + size_t(j)*width, width);
+    for (unsigned j = 0; j < cheight; ++j) {
+        const unsigned char *row0 = rgb + size_t(2*j)*width*3;
+        const unsigned char *row1 = 2*j+1 < height ? row0 + width*3 : row0;
+        convertRowsUV(row0, row1, usum.data(), vsum.data(), width);
+        usum[2*cwidth-1] = usum[width-1];
+        vsum[2*cwidth-1] = vsum[width-1];
+        subsampleRow(usum.data(), u + size_t(j)*cwidth, cwidth);
+        subsampleRow(vsum.data(), v + size_t(j)*cwidth, cwidth);
+    }
+}
+
+void Y4MWriter::write(OffscreenSurface *s)
+{
+    TRACE_SCOPE("writeY4M");
+    if (width == 0) {
+        width = s->getWidth();
+        height = s->getHeight();
+        char header[128];
+        int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+        writeData(header, len);
+    }
+    if (s->getWidth() != width || s->getHeight() != height)
+        throw std::runtime_error("Y4M stream frame size can not change");
+    size_t lumaSize = size_t(width)*height, chromaSize = size_t((width+1)/2)*((height+1)/2);
+    frame.resize(lumaSize + 2*chromaSize);
+    convertToYUV420(s->getRGBData(), width, height, frame.data(), frame.data()+lumaSize, frame.data()+lumaSize+chromaSize);
+    writeData("FRAME\n", 6);
+    writeData(frame.data(), frame.size());
+}
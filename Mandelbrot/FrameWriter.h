@@ -0,0 +1,69 @@
+/*
+ * Raw video frame writers
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_FrameWriter_h
+#define Mandelbrot_FrameWriter_h
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "OffsceenSurface.h"
+
+/* Streams surfaces as uncompressed frames into a file, named pipe or stdout ("-") */
+class FrameWriter {
+public:
+    virtual ~FrameWriter();
+    virtual void write(OffscreenSurface *s) = 0;
+    /* Format is either "ppm" or "y4m", returns NULL for unknown formats */
+    static FrameWriter *create(const std::string &format, const std::string &path);
+
+protected:
+    FrameWriter(const std::string &path);
+    void writeData(const void *data, size_t size);
+    FILE *out;
+};
+
+/* Concatenated binary PPM (P6) images, as understood by image2pipe demuxers */
+class PPMWriter: public FrameWriter {
+public:
+    PPMWriter(const std::string &path): FrameWriter(path) {}
+    void write(OffscreenSurface *s);
+};
+
+/* YUV4MPEG2 stream with 4:2:0 JPEG-sited chroma and BT.601 studio range */
+class Y4MWriter: public FrameWriter {
+public:
+    Y4MWriter(const std::string &path, unsigned fps = 30): FrameWriter(path), frameRate(fps), width(0), height(0) {}
+    void write(OffscreenSurface *s);
+    /* Convert packed RGB to planar Y and 2x2 subsampled U and V planes */
+    static void convertToYUV420(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *y, unsigned char *u, unsigned char *v);
+
+private:
+    unsigned frameRate;
+    unsigned width, height;
+    std::vector<unsigned char> frame;
+};
+
+#endif
@@ -47,6 +47,9 @@ GLUTWrapper::GLUTWrapper(int *argc, char **argv) {
     displayFunc = [] {};
     reshapeFunc = [](int w,int h) {};
     mouseFunc = [](int x, int y, unsigned b) {};
+    keyboardFunc = [](unsigned char key) {};
+    redisplayPending = false;
+    frameInterval = 1000/30;
     glutInit (argc, argv);
 }
 
@@ -58,6 +61,8 @@ void GLUTWrapper::init(int width, int height) {
     glutReshapeFunc(GLUTWrapper::reshape);
     glutMouseFunc(GLUTWrapper::mouse);
     glutMotionFunc(GLUTWrapper::motion);
+    glutKeyboardFunc(GLUTWrapper::keyboard);
+    glutTimerFunc(frameInterval, GLUTWrapper::timer, 0);
 }
 
 void GLUTWrapper::run()
@@ -76,6 +81,13 @@ void GLUTWrapper::redisplay()
     glutPostRedisplay();
 }
 
+void GLUTWrapper::timer(int)
+{
+    if (self->redisplayPending.exchange(false))
+        glutPostRedisplay();
+    glutTimerFunc(self->frameInterval, GLUTWrapper::timer, 0);
+}
+
 void GLUTWrapper::display()
 {
     self->displayFunc();
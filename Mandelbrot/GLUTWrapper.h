@@ -27,6 +27,9 @@
 #define Mandelbrot_GLUTWrapper_h
 
 #include <functional>
+#include <string>
+#include <atomic>
+#include <algorithm>
 
 class GLUTWrapper {
 public:
@@ -39,19 +42,28 @@ public:
     void setDisplayFunc(std::function<void()> f) { displayFunc = f;}
     void setReshapeFunc(std::function<void(int,int)> f) { reshapeFunc = f;}
     void setMouseFunc(std::function<void(int,int,unsigned)> f) { mouseFunc = f;}
+    void setKeyboardFunc(std::function<void(unsigned char)> f) { keyboardFunc = f;}
     void redisplay();
+    /* Thread safe redisplay request, coalesced and served at most maxFrameRate times per second */
+    void postRedisplay() { redisplayPending.store(true); }
+    void setMaxFrameRate(unsigned fps) { frameInterval = 1000/std::max(fps, 1u); }
 private:
     unsigned mouseButtons;
     static void display();
+    static void timer(int);
     static void reshape(int w, int h) { self->reshapeFunc(w,h);}
     static void mouse(int b, int s, int x,int y);
     static void motion(int x, int y);
+    static void keyboard(unsigned char key, int x, int y) { self->keyboardFunc(key); }
     std::function<void()> displayFunc;
     std::function<void(int,int)> reshapeFunc;
     std::function<void(int,int,unsigned)> mouseFunc;
+    std::function<void(unsigned char)> keyboardFunc;
     static GLUTWrapper *self;
     int winWidth, winHeight;
     int winId;
+    std::atomic<bool> redisplayPending;
+    unsigned frameInterval;
 };
 
 #endif
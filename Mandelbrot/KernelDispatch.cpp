@@ -0,0 +1,110 @@
+/*
+ * Selection of the kernel set matching the CPU
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Kernels.h"
+#include <iostream>
+#include <atomic>
+#include <stdlib.h>
+
+#define DECLARE_KERNELS(isa) \
+    void quadraticD_##isa(const double *, const double *, const double *, const double *, unsigned, unsigned, const double *, unsigned *, double *); \
+    void quadraticF_##isa(const float *, const float *, const float *, const float *, unsigned, unsigned, const float *, unsigned *, float *);
+
+/* Makefile builds Kernels.cpp for SSE2, AVX2 and AVX-512 on x86 and defines KERNELS_X86, elsewhere only the generic build exists */
+#ifdef KERNELS_X86
+DECLARE_KERNELS(sse2)
+DECLARE_KERNELS(avx2)
+DECLARE_KERNELS(avx512)
+static const KernelSet kernelSets[] = {
+    {"sse2", quadraticD_sse2, quadraticF_sse2},
+    {"avx2", quadraticD_avx2, quadraticF_avx2},
+    {"avx512", quadraticD_avx512, quadraticF_avx512},
+};
+
+static bool isSupported(const KernelSet &k)
+{
+    std::string name(k.name);
+    __builtin_cpu_init();
+    if (name == "avx512") return __builtin_cpu_supports("avx512f");
+    if (name == "avx2") return __builtin_cpu_supports("avx2");
+    return true;
+}
+#else
+DECLARE_KERNELS(generic)
+static const KernelSet kernelSets[] = {
+    {"generic", quadraticD_generic, quadraticF_generic},
+};
+
+static bool isSupported(const KernelSet &) { return true; }
+#endif
+
+static const unsigned numKernelSets = sizeof(kernelSets)/sizeof(kernelSets[0]);
+static std::atomic<const KernelSet *> selected(nullptr);
+
+static const KernelSet *findKernels(const std::string &name)
+{
+    for (unsigned i = 0; i < numKernelSets; ++i)
+        if (name == kernelSets[i].name && isSupported(kernelSets[i]))
+            return &kernelSets[i];
+    return nullptr;
+}
+
+static const KernelSet *detectKernels()
+{
+    auto env = getenv("MANDEL_ISA");
+    if (env && *env) {
+        if (auto rc = findKernels(env))
+            return rc;
+        std::cerr<<"Kernel set "<<env<<" from MANDEL_ISA is not available, detecting"<<std::endl;
+    }
+    const KernelSet *rc = &kernelSets[0];
+    for (unsigned i = 1; i < numKernelSets; ++i)
+        if (isSupported(kernelSets[i]))
+            rc = &kernelSets[i];
+    return rc;
+}
+
+const KernelSet &getKernels()
+{
+    static const KernelSet *detected = detectKernels();
+    auto rc = selected.load(std::memory_order_relaxed);
+    return rc ? *rc : *detected;
+}
+
+bool selectKernels(const std::string &name)
+{
+    auto rc = findKernels(name);
+    if (rc) selected = rc;
+    return rc != nullptr;
+}
+
+std::vector<std::string> availableKernels()
+{
+    std::vector<std::string> rc;
+    for (unsigned i = 0; i < numKernelSets; ++i)
+        if (isSupported(kernelSets[i]))
+            rc.push_back(kernelSets[i].name);
+    return rc;
+}
@@ -0,0 +1,124 @@
+/*
+ * Vectorized iteration kernels built for several instruction sets
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Compiled once per instruction set with KERNEL_ISA naming the variant; must be built with
+ * -ffp-contract=off, as fused multiply-adds would round differently from the scalar renderers */
+
+#include "Kernels.h"
+#include <algorithm>
+
+#ifndef KERNEL_ISA
+#define KERNEL_ISA generic
+#endif
+#define KERNEL_CONCAT_(a, b) a##_##b
+#define KERNEL_CONCAT(a, b) KERNEL_CONCAT_(a, b)
+#define KERNEL_NAME(name) KERNEL_CONCAT(name, KERNEL_ISA)
+
+/* Orbits iterated together: a multiple of the widest vector, small enough to stay in registers */
+static const unsigned lanes = 16;
+
+/* Trap check is compiled in only when there is a trap, so that Mandelbrot orbits do not pay for it */
+template<typename T, bool Trap> static void quadraticBatch(const T *__restrict xr0, const T *__restrict xi0, const T *__restrict cr, const T *__restrict ci,
+                                                           unsigned maxIter, const T *trap, unsigned *__restrict steps, T *__restrict norms)
+{
+    T trapRe = Trap ? trap[0] : 0, trapIm = Trap ? trap[1] : 0, trapRadius2 = Trap ? trap[2] : 0;
+    T xr[lanes], xi[lanes], escNorm[lanes];
+    unsigned esc[lanes];
+    for (unsigned l = 0; l < lanes; ++l) {
+        xr[l] = xr0[l];
+        xi[l] = xi0[l];
+        escNorm[l] = 0;
+        esc[l] = 0;
+    }
+    for (unsigned k = 0; k < maxIter;) {
+        /* Escaped orbits keep iterating branch-free, their state is frozen in esc/escNorm;
+         * all-escaped check is amortized over a few steps */
+        unsigned end = std::min(maxIter, k + 8);
+        for (; k < end; ++k)
+            for (unsigned l = 0; l < lanes; ++l) {
+                T nr = xr[l]*xr[l] - xi[l]*xi[l] + cr[l];
+                T ni = xr[l]*xi[l] + xi[l]*xr[l] + ci[l];
+                xr[l] = nr;
+                xi[l] = ni;
+                T n = nr*nr + ni*ni;
+                bool escaped = n > T(4.0);
+                if (Trap) {
+                    T dr = nr - trapRe, di = ni - trapIm;
+                    escaped = escaped || dr*dr + di*di < trapRadius2;
+                }
+                bool hit = escaped && esc[l] == 0;
+                esc[l] = hit ? k + 1 : esc[l];
+                escNorm[l] = hit && n > T(4.0) ? n : escNorm[l];
+            }
+        unsigned live = 0;
+        for (unsigned l = 0; l < lanes; ++l)
+            live += esc[l] == 0;
+        if (live == 0) break;
+    }
+    for (unsigned l = 0; l < lanes; ++l) {
+        steps[l] = esc[l];
+        norms[l] = escNorm[l];
+    }
+}
+
+template<typename T, bool Trap> static void quadratic(const T *xr, const T *xi, const T *cr, const T *ci, unsigned n, unsigned maxIter, const T *trap,
+                                                      unsigned *steps, T *norms)
+{
+    unsigned full = n/lanes*lanes;
+    for (unsigned i = 0; i < full; i += lanes)
+        quadraticBatch<T, Trap>(xr+i, xi+i, cr+i, ci+i, maxIter, trap, steps+i, norms+i);
+    if (full == n) return;
+    /* Pad the tail with copies of its last orbit */
+    T pxr[lanes], pxi[lanes], pcr[lanes], pci[lanes], pnorms[lanes];
+    unsigned psteps[lanes];
+    for (unsigned l = 0; l < lanes; ++l) {
+        unsigned src = std::min(full + l, n - 1);
+        pxr[l] = xr[src];
+        pxi[l] = xi[src];
+        pcr[l] = cr[src];
+        pci[l] = ci[src];
+    }
+    quadraticBatch<T, Trap>(pxr, pxi, pcr, pci, maxIter, trap, psteps, pnorms);
+    std::copy(psteps, psteps + (n - full), steps + full);
+    std::copy(pnorms, pnorms + (n - full), norms + full);
+}
+
+void KERNEL_NAME(quadraticD)(const double *xr, const double *xi, const double *cr, const double *ci, unsigned n, unsigned maxIter, const double *trap,
+                             unsigned *steps, double *norms)
+{
+    if (trap)
+        quadratic<double, true>(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+    else
+        quadratic<double, false>(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+}
+
+void KERNEL_NAME(quadraticF)(const float *xr, const float *xi, const float *cr, const float *ci, unsigned n, unsigned maxIter, const float *trap,
+                             unsigned *steps, float *norms)
+{
+    if (trap)
+        quadratic<float, true>(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+    else
+        quadratic<float, false>(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+}
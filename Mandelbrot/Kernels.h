@@ -0,0 +1,67 @@
+/*
+ * Vectorized iteration kernels built for several instruction sets
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_Kernels_h
+#define Mandelbrot_Kernels_h
+
+#include <string>
+#include <vector>
+
+/* Iterate x = x^2 + c for n independent orbits side by side, so that the compiler can keep one orbit
+ * per SIMD lane. Escape step (1-based, 0 if the orbit stayed bounded for maxIter steps) and squared
+ * modulus at escape are stored per orbit; arithmetic matches std::complex operation for operation.
+ * Unless trap is null, orbits coming closer than sqrt(trap[2]) to trap[0] + i*trap[1] stop there
+ * and report the step they were trapped at with a modulus of 0 */
+typedef void (*QuadraticKernelD)(const double *xr, const double *xi, const double *cr, const double *ci,
+                                 unsigned n, unsigned maxIter, const double *trap, unsigned *steps, double *norms);
+typedef void (*QuadraticKernelF)(const float *xr, const float *xi, const float *cr, const float *ci,
+                                 unsigned n, unsigned maxIter, const float *trap, unsigned *steps, float *norms);
+
+struct KernelSet {
+    const char *name;
+    QuadraticKernelD quadraticD;
+    QuadraticKernelF quadraticF;
+};
+
+/* Fastest set the CPU supports, or the one forced by selectKernels() or $MANDEL_ISA */
+const KernelSet &getKernels();
+/* Force kernel set by name, returns false if it is not built in or not supported by this CPU */
+bool selectKernels(const std::string &name);
+/* Names of kernel sets this CPU can run, slowest first */
+std::vector<std::string> availableKernels();
+
+inline void quadraticEscape(const double *xr, const double *xi, const double *cr, const double *ci, unsigned n, unsigned maxIter,
+                            const double *trap, unsigned *steps, double *norms)
+{
+    getKernels().quadraticD(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+}
+
+inline void quadraticEscape(const float *xr, const float *xi, const float *cr, const float *ci, unsigned n, unsigned maxIter,
+                            const float *trap, unsigned *steps, float *norms)
+{
+    getKernels().quadraticF(xr, xi, cr, ci, n, maxIter, trap, steps, norms);
+}
+
+#endif
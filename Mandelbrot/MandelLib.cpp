@@ -0,0 +1,144 @@
+/*
+ * Embeddable render library C API
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "MandelLib.h"
+#include "DynamicalSystems.h"
+#include "EscapeTimeRenderer.h"
+#include "AttractionPointRenderer.h"
+#include <new>
+#include <vector>
+
+struct mandel_handle {
+    mandel_renderer renderer;
+    Palette palette;
+    std::function<DynamicalSystem<double> *()> factory;
+};
+
+int mandel_api_version(void)
+{
+    return MANDEL_API_VERSION;
+}
+
+static std::function<DynamicalSystem<double> *()> makeFactory(const mandel_config *config)
+{
+    std::complex<double> param(config->param_re, config->param_im);
+    switch (config->system) {
+    case MANDEL_MANDELBROT:
+        return [] { return new Mandelbrot<double>(); };
+    case MANDEL_JULIA:
+        return [param] { return new Julia<double>(param.real(), param.imag()); };
+    case MANDEL_MULTIBROT:
+        return [param] { return new Multibrot<double>(param.real()); };
+    case MANDEL_NEWTON: {
+        if (config->coefficients == NULL || config->degree == 0)
+            return nullptr;
+        Polynomial<double> poly(std::vector<double>(config->coefficients, config->coefficients + config->degree + 1));
+        return [poly] { return new Newton<double>(poly); };
+    }
+    }
+    return nullptr;
+}
+
+mandel_handle *mandel_create(const mandel_config *config)
+{
+    if (config == NULL || (config->renderer != MANDEL_ESCAPE_TIME && config->renderer != MANDEL_ATTRACTION_POINT))
+        return NULL;
+    try {
+        auto factory = makeFactory(config);
+        if (!factory) return NULL;
+        mandel_handle *rc = new mandel_handle();
+        rc->renderer = config->renderer;
+        rc->factory = factory;
+        rc->palette = BuildVGAPalette();
+        if (config->palette)
+            for (unsigned i = 0; i < 256; ++i)
+                rc->palette[i] = RGB<unsigned char>(config->palette[3*i], config->palette[3*i+1], config->palette[3*i+2]);
+        return rc;
+    } catch (...) {
+        return NULL;
+    }
+}
+
+void mandel_destroy(mandel_handle *handle)
+{
+    delete handle;
+}
+
+template<typename Renderer> static std::pair<double, double> renderRegion(OffscreenSurface *s, const mandel_handle *handle,
+                                                                          std::complex<double> tl, std::complex<double> br, const mandel_view *view) {
+    Renderer renderer(s, handle->factory);
+    renderer.setBounds(tl, br);
+    renderer.setIterations(view->iterations);
+    renderer.setThreads(view->threads);
+    return renderer.render();
+}
+
+int mandel_render(const mandel_handle *handle, const mandel_view *view, unsigned char *pixels, size_t stride, mandel_pixel_format format, mandel_result *result)
+{
+    if (handle == NULL || view == NULL || pixels == NULL || view->width == 0 || view->height == 0 || view->iterations == 0)
+        return MANDEL_EINVAL;
+    unsigned w = view->w ? view->w : view->width, h = view->h ? view->h : view->height;
+    unsigned x = view->w ? view->x : 0, y = view->h ? view->y : 0;
+    unsigned bpp = format == MANDEL_RGBX32 ? 4 : 3;
+    if ((format != MANDEL_RGB24 && format != MANDEL_RGBX32) || x+w > view->width || y+h > view->height || stride < size_t(w)*bpp)
+        return MANDEL_EINVAL;
+    /* Attraction point colors depend on the points found so far, so regions rendered apart would not match */
+    if (handle->renderer == MANDEL_ATTRACTION_POINT && (w != view->width || h != view->height))
+        return MANDEL_EINVAL;
+
+    /* Region is rendered as a view of its own, with the same pixel grid as the whole image */
+    std::complex<double> step((view->re1-view->re0)/view->width, (view->im1-view->im0)/view->height);
+    std::complex<double> tl(view->re0 + x*step.real(), view->im0 + y*step.imag());
+    std::complex<double> br(tl.real() + w*step.real(), tl.imag() + h*step.imag());
+    try {
+        Palette palette(handle->palette);
+        OffscreenSurface surface(w, h, palette, pixels, stride, bpp);
+        std::pair<double, double> rc;
+        if (handle->renderer == MANDEL_ESCAPE_TIME)
+            rc = renderRegion<EscapeTimeRenderer<double> >(&surface, handle, tl, br, view);
+        else
+            rc = renderRegion<AttractionPointRenderer<double> >(&surface, handle, tl, br, view);
+        if (result) {
+            result->value = rc.first;
+            result->milliseconds = rc.second;
+        }
+    } catch (const std::bad_alloc &) {
+        return MANDEL_ENOMEM;
+    } catch (...) {
+        return MANDEL_EFAIL;
+    }
+    return MANDEL_OK;
+}
+
+const char *mandel_strerror(int status)
+{
+    switch (status) {
+    case MANDEL_OK: return "Success";
+    case MANDEL_EINVAL: return "Invalid argument";
+    case MANDEL_ENOMEM: return "Out of memory";
+    case MANDEL_EFAIL: return "Render failed";
+    }
+    return "Unknown error";
+}
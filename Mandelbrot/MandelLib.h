@@ -0,0 +1,113 @@
+/*
+ * Embeddable render library C API
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_MandelLib_h
+#define Mandelbrot_MandelLib_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define MANDEL_API __attribute__((visibility("default")))
+#else
+#define MANDEL_API
+#endif
+
+#define MANDEL_API_VERSION 1
+
+typedef enum {
+    MANDEL_MANDELBROT,      /* x = x^2 + c */
+    MANDEL_JULIA,           /* x = x^2 + param */
+    MANDEL_MULTIBROT,       /* x = x^param.re + c */
+    MANDEL_NEWTON           /* Newton's method for polynomial with given coefficients */
+} mandel_system;
+
+typedef enum {
+    MANDEL_ESCAPE_TIME,
+    MANDEL_ATTRACTION_POINT
+} mandel_renderer;
+
+typedef enum {
+    MANDEL_RGB24,           /* 3 bytes per pixel */
+    MANDEL_RGBX32           /* 4 bytes per pixel, fourth byte is left untouched */
+} mandel_pixel_format;
+
+typedef enum {
+    MANDEL_OK = 0,
+    MANDEL_EINVAL = -1,
+    MANDEL_ENOMEM = -2,
+    MANDEL_EFAIL = -3
+} mandel_status;
+
+typedef struct {
+    mandel_system system;
+    mandel_renderer renderer;
+    double param_re, param_im;
+    /* Newton polynomial coefficients, lowest degree first, copied by mandel_create() */
+    const double *coefficients;
+    unsigned degree;
+    /* 256 RGB triplets copied by mandel_create(), NULL selects VGA palette */
+    const unsigned char *palette;
+} mandel_config;
+
+typedef struct {
+    /* Points of the complex plane at the top-left and bottom-right corners of the whole image */
+    double re0, im0, re1, im1;
+    unsigned width, height;
+    /* Region of the image to render into the buffer, zero w or h selects the whole image.
+     * MANDEL_ATTRACTION_POINT renders color points in the order they are found, so they take whole images only */
+    unsigned x, y, w, h;
+    unsigned iterations;
+    /* Worker threads for this call, 0 selects one per section; MANDEL_ATTRACTION_POINT renders ignore it
+     * and run on the calling thread */
+    unsigned threads;
+} mandel_view;
+
+typedef struct {
+    /* Interior area for escape time renders, number of attraction points otherwise */
+    double value;
+    double milliseconds;
+} mandel_result;
+
+/* Immutable once created, so one handle can serve concurrent renders from many threads */
+typedef struct mandel_handle mandel_handle;
+
+MANDEL_API int mandel_api_version(void);
+MANDEL_API mandel_handle *mandel_create(const mandel_config *config);
+MANDEL_API void mandel_destroy(mandel_handle *handle);
+/* Render view region into caller owned pixels, rows stride bytes apart; result may be NULL.
+ * No frame sized memory is allocated and pixels are written directly into the buffer */
+MANDEL_API int mandel_render(const mandel_handle *handle, const mandel_view *view,
+                             unsigned char *pixels, size_t stride, mandel_pixel_format format, mandel_result *result);
+MANDEL_API const char *mandel_strerror(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
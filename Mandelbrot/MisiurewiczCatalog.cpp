@@ -0,0 +1,279 @@
+/*
+ * Misiurewicz points enumerated in batch, and their memory mapped on-disk catalog
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "MisiurewiczCatalog.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <stdexcept>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef std::complex<double> complex;
+
+static const char catalogMagic[8] = {'M', 'N', 'D', 'L', 'M', 'I', 'S', '1'};
+
+struct CatalogHeader {
+    char magic[8];
+    uint32_t count, entrySize;
+};
+
+/* G'/G at c for G = z_{k+n-1} + z_{k-1}, or z_n for k = 0, z_i being the critical orbit. Since
+ * z_{k+n} - z_k = (z_{k+n-1} - z_{k-1})*(z_{k+n-1} + z_{k-1}), roots of G are the points of f^{k+n}(0) = f^k(0)
+ * whose preperiod is not below k, plus centers whose period divides k-1. G is evaluated by iterating the
+ * orbit, expanded coefficients of it are too large to be accurate beyond degree 32 or so. Once the orbit is
+ * large enough for c not to matter, the logarithmic derivative just doubles every step, which keeps far away
+ * starting points from overflowing */
+static complex logDerivative(const complex &c, unsigned k, unsigned n)
+{
+    unsigned m = k ? k+n-1 : n;
+    complex z(0), dz(0), zk(0), dzk(0);
+    for (unsigned i = 1; i <= m; ++i) {
+        if (i == k) {
+            zk = z;
+            dzk = dz;
+        }
+        if (norm(z) > 1e60) {
+            complex l = dz/z;
+            for (; i <= m; ++i) l *= 2;
+            return l;
+        }
+        dz = 2.*z*dz + 1.;
+        z = z*z + c;
+    }
+    return (dz + dzk)/(z + zk);
+}
+
+/* Preperiod and period of c, checking that they are k and a divisor of n. The orbit is repelling, so
+ * instead of comparing its points, a root is accepted if a Newton step towards it is negligibly small */
+static bool classify(const complex &c, unsigned k, unsigned n, MisiurewiczCatalog::Entry &e)
+{
+    std::vector<complex> z(k+n+1, 0), dz(k+n+1, 0);
+    for (unsigned i = 1; i <= k+n; ++i) {
+        dz[i] = 2.*z[i-1]*dz[i-1] + 1.;
+        z[i] = z[i-1]*z[i-1] + c;
+    }
+    auto isRoot = [&](unsigned i, unsigned j) {
+        return std::abs(z[i] - z[j]) <= 1e-9*std::abs(dz[i] - dz[j]);
+    };
+    if (!isRoot(k+n, k) || (k && isRoot(k+n-1, k-1)))
+        return false;
+    e.re = c.real();
+    e.im = c.imag();
+    e.preperiod = k;
+    for (e.period = 1; n % e.period || !isRoot(k+e.period, k); ++e.period);
+    return true;
+}
+
+/* Degree of G: number of roots findPoints() iterates on for (k, n) */
+static size_t getDegree(unsigned k, unsigned n)
+{
+    return size_t(1) << (k ? k+n-2 : n-1);
+}
+
+/* Below this degree a whole sweep costs less than starting the threads for it */
+static const size_t parallelDegree = 256;
+
+/* One Aberth sweep over roots [begin, end), computed from the previous approximations r only, so that the
+ * result does not depend on how the roots are split among threads. Returns how many have not converged */
+static size_t aberthSweep(const std::vector<complex> &r, std::vector<complex> &next, std::vector<char> &done,
+                          size_t begin, size_t end, unsigned k, unsigned n)
+{
+    size_t active = 0;
+    for (size_t j = begin; j < end; ++j) {
+        next[j] = r[j];
+        if (done[j]) continue;
+        complex w = logDerivative(r[j], k, n), sum(0);
+        for (size_t i = 0; i < r.size(); ++i) {
+            if (i == j) continue;
+            complex q = r[j] - r[i];
+            sum += conj(q)/norm(q);
+        }
+        complex step = 1./(w - sum);
+        next[j] = r[j] - step;
+        if (!(std::abs(step) > 1e-15*std::max(1., std::abs(next[j]))))
+            done[j] = true;
+        else
+            active++;
+    }
+    return active;
+}
+
+/* All roots of G at once by Aberth's method, starting from a circle around the Mandelbrot set. Getting
+ * from the circle to the roots takes about d/2 sweeps of d^2 steps each, after which convergence is cubic.
+ * From parallelDegree on, every sweep is split among threads */
+static std::vector<MisiurewiczCatalog::Entry> findPoints(unsigned k, unsigned n, unsigned threads)
+{
+    size_t d = getDegree(k, n);
+    size_t maxIterations = 100 + d;
+    std::vector<complex> r(d), next(d);
+    std::vector<char> done(d, false);
+    for (size_t j = 0; j < d; ++j)
+        r[j] = std::polar(2.5, 2*M_PI*(j+.25)/d);
+    size_t chunks = d < parallelDegree ? 1 : std::min<size_t>(threads, d);
+    for (size_t it = 0; it < maxIterations; ++it) {
+        std::vector<std::future<size_t> > sweeps;
+        for (size_t c = 1; c < chunks; ++c)
+            sweeps.push_back(std::async(std::launch::async, aberthSweep, std::cref(r), std::ref(next), std::ref(done),
+                                        c*d/chunks, (c+1)*d/chunks, k, n));
+        size_t active = aberthSweep(r, next, done, 0, d/chunks, k, n);
+        for (auto &s: sweeps)
+            active += s.get();
+        r.swap(next);
+        if (!active) break;
+    }
+    std::vector<MisiurewiczCatalog::Entry> rc;
+    MisiurewiczCatalog::Entry e;
+    for (auto &c: r)
+        if (classify(c, k, n, e))
+            rc.push_back(e);
+    return rc;
+}
+
+static bool entryLess(const MisiurewiczCatalog::Entry &a, const MisiurewiczCatalog::Entry &b)
+{
+    if (a.preperiod != b.preperiod) return a.preperiod < b.preperiod;
+    if (a.period != b.period) return a.period < b.period;
+    if (a.re != b.re) return a.re < b.re;
+    return a.im < b.im;
+}
+
+std::vector<MisiurewiczCatalog::Entry> MisiurewiczCatalog::enumerate(unsigned k0, unsigned k1, unsigned n0, unsigned n1, unsigned threads)
+{
+    /* Largest polynomials first, each of those split among all threads in turn; smaller ones are one task per
+     * thread, so that no thread is left with a large one at the end */
+    std::vector<std::pair<unsigned, unsigned> > tasks;
+    for (unsigned k = k0; k <= k1; ++k)
+        for (unsigned n = std::max(n0, 1u); n <= n1 && k != 1; ++n)
+            tasks.push_back(std::make_pair(k, n));
+    std::stable_sort(tasks.begin(), tasks.end(), [](const std::pair<unsigned, unsigned> &a, const std::pair<unsigned, unsigned> &b) {
+        return getDegree(a.first, a.second) > getDegree(b.first, b.second);
+    });
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::vector<Entry> > found(tasks.size());
+    std::atomic<size_t> next(0);
+    for (; next < tasks.size() && getDegree(tasks[next].first, tasks[next].second) >= parallelDegree; ++next)
+        found[next] = findPoints(tasks[next].first, tasks[next].second, threads);
+    auto work = [&] {
+        for (size_t i = next++; i < tasks.size(); i = next++)
+            found[i] = findPoints(tasks[i].first, tasks[i].second, 1);
+    };
+    std::vector<std::future<void> > rc;
+    for (unsigned i = 1; i < std::min<size_t>(threads, tasks.size() - next); ++i)
+        rc.push_back(std::async(std::launch::async, work));
+    work();
+    for (auto &r: rc)
+        r.get();
+
+    /* Points of period p turn up for every n divisible by p, keep one of every cluster of the same label */
+    std::vector<Entry> all;
+    for (auto &f: found)
+        all.insert(all.end(), f.begin(), f.end());
+    std::sort(all.begin(), all.end(), entryLess);
+    const double tolerance = 1e-9;
+    std::vector<Entry> entries;
+    size_t labelStart = 0;
+    for (auto &e: all) {
+        if (labelStart < entries.size() && (entries[labelStart].preperiod != e.preperiod || entries[labelStart].period != e.period))
+            labelStart = entries.size();
+        bool duplicate = false;
+        for (size_t i = entries.size(); i-- > labelStart && e.re - entries[i].re <= tolerance && !duplicate;)
+            duplicate = std::fabs(e.im - entries[i].im) <= tolerance;
+        if (!duplicate)
+            entries.push_back(e);
+    }
+    return entries;
+}
+
+void MisiurewiczCatalog::save(const std::string &path, const std::vector<Entry> &entries)
+{
+    CatalogHeader header;
+    memcpy(header.magic, catalogMagic, sizeof(header.magic));
+    header.count = entries.size();
+    header.entrySize = sizeof(Entry);
+    FILE *out = fopen(path.c_str(), "wb");
+    if (!out)
+        throw std::runtime_error(path + ": " + strerror(errno));
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(entries.data(), sizeof(Entry), entries.size(), out) == entries.size();
+    if (fclose(out) != 0 || !ok)
+        throw std::runtime_error(path + ": " + strerror(errno));
+}
+
+MisiurewiczCatalog::~MisiurewiczCatalog()
+{
+    unmap();
+}
+
+void MisiurewiczCatalog::unmap()
+{
+    if (map)
+        munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+    entries = NULL;
+    count = 0;
+}
+
+bool MisiurewiczCatalog::load(const std::string &path)
+{
+    unmap();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(CatalogHeader)) {
+        mapSize = st.st_size;
+        map = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            map = NULL;
+    }
+    close(fd);
+    if (!map) return false;
+    auto header = static_cast<const CatalogHeader *>(map);
+    if (memcmp(header->magic, catalogMagic, sizeof(catalogMagic)) != 0 || header->entrySize != sizeof(Entry) ||
+        mapSize != sizeof(CatalogHeader) + size_t(header->count)*sizeof(Entry)) {
+        unmap();
+        return false;
+    }
+    entries = reinterpret_cast<const Entry *>(header + 1);
+    count = header->count;
+    return true;
+}
+
+std::vector<std::complex<double> > MisiurewiczCatalog::getRoots(unsigned k, unsigned n) const
+{
+    std::vector<std::complex<double> > rc;
+    for (auto &e: *this)
+        if (e.preperiod <= k && n % e.period == 0)
+            rc.push_back(std::complex<double>(e.re, e.im));
+    return rc;
+}
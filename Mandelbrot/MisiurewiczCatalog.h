@@ -0,0 +1,75 @@
+/*
+ * Misiurewicz points enumerated in batch, and their memory mapped on-disk catalog
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_MisiurewiczCatalog_h
+#define Mandelbrot_MisiurewiczCatalog_h
+
+#include <string>
+#include <vector>
+#include <complex>
+#include <stdint.h>
+
+/* Parameters c whose critical orbit 0, c, c^2+c, ... becomes periodic with the given period after exactly
+ * preperiod steps; preperiod 0 are the centers of hyperbolic components. A catalog file is a 16 byte header
+ * followed by the entries sorted by preperiod, period, real and imaginary part, in host byte order, so that
+ * loading it is a single mmap */
+class MisiurewiczCatalog {
+public:
+    struct Entry {
+        double re, im;
+        uint32_t preperiod, period;
+    };
+
+    MisiurewiczCatalog(): map(NULL), mapSize(0), entries(NULL), count(0) {}
+    ~MisiurewiczCatalog();
+
+    /* All points of preperiod in [k0, k1] whose period divides some n in [n0, n1], found in parallel, one
+     * (k, n) pair per task, or all threads on one pair for the largest ones; 0 threads means one per core.
+     * Preperiod 1 does not exist and is skipped. Each pair solves a polynomial of degree 2^(k+n-2), 2^(n-1) for
+     * k = 0, in time cubic in it, so every step of the largest k+n costs eight times as much as the last */
+    static std::vector<Entry> enumerate(unsigned k0, unsigned k1, unsigned n0, unsigned n1, unsigned threads = 0);
+    static void save(const std::string &path, const std::vector<Entry> &entries);
+
+    /* Map catalog at path read-only, false if it is missing or not a catalog */
+    bool load(const std::string &path);
+    size_t size() const { return count; }
+    const Entry &operator[](size_t i) const { return entries[i]; }
+    const Entry *begin() const { return entries; }
+    const Entry *end() const { return entries + count; }
+    /* Roots of f^{k+n}(0) = f^k(0): points of preperiod at most k whose period divides n */
+    std::vector<std::complex<double> > getRoots(unsigned k, unsigned n) const;
+
+private:
+    MisiurewiczCatalog(const MisiurewiczCatalog &);
+    MisiurewiczCatalog &operator=(const MisiurewiczCatalog &);
+    void unmap();
+
+    void *map;
+    size_t mapSize;
+    const Entry *entries;
+    size_t count;
+};
+
+#endif
@@ -24,10 +24,15 @@
  */
 
 #include "OffsceenSurface.h"
+#include "vgapalette.h"
 #include <random>
 #include <assert.h>
 #include <string.h>
 #include <fstream>
+#include <algorithm>
+#include <new>
+#include <cmath>
+#include <stdlib.h>
 
 void Palette::save(const std::string &name)
 {
@@ -92,6 +97,14 @@ void Palette::randomizeUV(unsigned char Y, unsigned distance)
     }
 }
 
+Palette BuildVGAPalette()
+{
+    Palette rc;
+    for (unsigned i=0;i<256;++i)
+        rc[i] =  RGB<unsigned char>((vga_palette[i]>>16)&0xff, (vga_palette[i]>>8)&0xff,vga_palette[i]&0xff);
+    return rc;
+}
+
 RGB<unsigned char >& Palette::operator[](size_t idx)
 {
     assert (idx < data.size());
@@ -99,23 +112,66 @@ RGB<unsigned char >& Palette::operator[](size_t idx)
 }
 
 
-OffscreenSurface::OffscreenSurface(unsigned w, unsigned h):width(w),height(h)
+OffscreenSurface::OffscreenSurface(unsigned w, unsigned h, Layout l):width(w),height(h),layout(l),ownsData(true)
+{
+    allocate();
+}
+
+OffscreenSurface::OffscreenSurface(unsigned w, unsigned h, Palette &p, Layout l):width(w),height(h),layout(l),ownsData(true),palette(p)
 {
-    rgb = new unsigned char[width*height*3];
+    allocate();
 }
 
-OffscreenSurface::OffscreenSurface(unsigned w, unsigned h, Palette &p):width(w),height(h),palette(p)
+OffscreenSurface::OffscreenSurface(unsigned w, unsigned h, Palette &p, unsigned char *buffer, size_t s, unsigned b):
+    width(w),height(h),layout(Linear),stride(s),bpp(b),ownsData(false),palette(p),rgb(buffer)
 {
-    rgb = new unsigned char[width*height*3];
+    assert(bpp == 3 || bpp == 4);
+    assert(stride >= size_t(width)*bpp);
+    allocate();
 }
 
+void OffscreenSurface::allocate()
+{
+    tilesX = (width+tileSize-1)/tileSize;
+    tilesY = (height+tileSize-1)/tileSize;
+    void *ptr = NULL;
+    if (ownsData) {
+        bpp = layout == Linear ? 3 : 4;
+        if (layout == Linear)
+            dataSize = size_t(width)*height*3;
+        else
+            dataSize = size_t(tilesX)*tilesY*tileSize*tileSize*4;
+        stride = size_t(width)*bpp;
+        /* Cache line aligned, so that tile boundaries are cache line boundaries */
+        if (posix_memalign(&ptr, 64, dataSize ? dataSize : 64) != 0)
+            throw std::bad_alloc();
+        rgb = static_cast<unsigned char *>(ptr);
+        memset(rgb, 0, dataSize);
+    } else
+        dataSize = height ? stride*(height-1)+size_t(width)*bpp : 0;
+    if (posix_memalign(&ptr, sizeof(DirtyFlag), sizeof(DirtyFlag)*tilesX*tilesY) != 0) {
+        if (ownsData) free(rgb);
+        throw std::bad_alloc();
+    }
+    dirty = static_cast<DirtyFlag *>(ptr);
+    for (unsigned i(0); i < tilesX*tilesY; ++i)
+        new (dirty + i) DirtyFlag();
+    markAllDirty();
+}
+
+void OffscreenSurface::markAllDirty()
+{
+    for (unsigned i(0); i < tilesX*tilesY; ++i)
+        dirty[i].flag.store(true, std::memory_order_release);
+}
 
 void OffscreenSurface::putPixel(unsigned x, unsigned y, unsigned char r, unsigned char g, unsigned char b)
 {
-    auto offs = (y*width+x)*3;
+    auto offs = offset(x, y);
     rgb[offs+0] = r;
     rgb[offs+1] = g;
     rgb[offs+2] = b;
+    markDirty(x, y);
 }
 
 void OffscreenSurface::putPixel(unsigned x, unsigned y, RGB<unsigned char> c)
@@ -128,27 +184,123 @@ void OffscreenSurface::putPixel(unsigned x, unsigned y, unsigned idx)
     putPixel(x,y, palette[idx]);
 }
 
-void OffscreenSurface::putPixel(unsigned x, unsigned y, float val)
+void OffscreenSurface::putSamples(unsigned x, unsigned y, const float *vals, unsigned n)
+{
+    if (n == 0) return;
+    float sum[3] = {0, 0, 0};
+    for (unsigned i(0); i < n; ++i) {
+        if (vals[i] < 0) continue;
+        auto c = getColor(vals[i]);
+        sum[0] += c.getR();
+        sum[1] += c.getG();
+        sum[2] += c.getB();
+    }
+    putPixel(x, y, (unsigned char)(sum[0]/n + .5f), (unsigned char)(sum[1]/n + .5f), (unsigned char)(sum[2]/n + .5f));
+}
+
+void OffscreenSurface::copyPixel(unsigned sx, unsigned sy, unsigned x, unsigned y)
+{
+    memcpy(rgb + offset(x, y), rgb + offset(sx, sy), 3);
+    markDirty(x, y);
+}
+
+RGB<unsigned char> OffscreenSurface::getColor(float val)
 {
-    val *= palette.size();
+    val = std::max(0.f, val*palette.size());
     unsigned idx = unsigned(floor(val));
-    if (idx >= palette.size()-1) {
-        putPixel(x,y, palette[palette.size()-1]);
+    if (idx >= palette.size()-1)
+        return palette[palette.size()-1];
+    float a = val - idx;
+    return (1-a)*palette[idx]+a*palette[idx+1];
+}
+
+void OffscreenSurface::putPixel(unsigned x, unsigned y, float val)
+{
+    putPixel(x,y, getColor(val));
+}
+
+void OffscreenSurface::putBlock(unsigned x, unsigned y, unsigned w, unsigned h, const float *vals)
+{
+    if (w == 0 || h == 0) return;
+    for (unsigned j(0); j < h; ++j)
+        for (unsigned i(0); i < w;) {
+            /* Pixels are contiguous up to the end of the row or of the tile row */
+            unsigned run = layout == Linear ? w - i : std::min(w - i, tileSize - (x+i)%tileSize);
+            unsigned char *dst = rgb + offset(x+i, y+j);
+            for (unsigned k(0); k < run; ++k, ++i, dst += bpp) {
+                auto v = vals[j*w+i];
+                if (v < 0) {
+                    dst[0] = dst[1] = dst[2] = 0;
+                    continue;
+                }
+                auto c = getColor(v);
+                dst[0] = c.getR();
+                dst[1] = c.getG();
+                dst[2] = c.getB();
+            }
+        }
+    for (unsigned ty(y/tileSize); ty <= (y+h-1)/tileSize; ++ty)
+        for (unsigned tx(x/tileSize); tx <= (x+w-1)/tileSize; ++tx)
+            markDirty(tx*tileSize, ty*tileSize);
+}
+
+void OffscreenSurface::copyTo(unsigned char *dst)
+{
+    if (isPacked()) {
+        memcpy(dst, rgb, dataSize);
         return;
     }
-    float a = val - idx;
-    putPixel(x,y, (1-a)*palette[idx]+a*palette[idx+1]);
+    if (layout == Linear) {
+        for (unsigned y(0); y < height; ++y) {
+            const unsigned char *in = rgb + offset(0, y);
+            for (unsigned x(0); x < width; ++x, dst += 3, in += bpp) {
+                dst[0] = in[0];
+                dst[1] = in[1];
+                dst[2] = in[2];
+            }
+        }
+        return;
+    }
+    for (unsigned ty(0); ty < tilesY; ++ty)
+        for (unsigned y(ty*tileSize); y < std::min(height, (ty+1)*tileSize); ++y) {
+            unsigned char *out = dst + size_t(y)*width*3;
+            const unsigned char *in = rgb + offset(0, y);
+            for (unsigned tx(0); tx < tilesX; ++tx, in += tileSize*tileSize*4) {
+                unsigned cnt = std::min(tileSize, width - tx*tileSize);
+                for (unsigned x(0); x < cnt; ++x, out += 3) {
+                    out[0] = in[4*x+0];
+                    out[1] = in[4*x+1];
+                    out[2] = in[4*x+2];
+                }
+            }
+        }
+}
+
+const unsigned char *OffscreenSurface::getRGBData()
+{
+    if (isPacked()) return rgb;
+    staging.resize(size_t(width)*height*3);
+    copyTo(staging.data());
+    return staging.data();
 }
 
 
 OffscreenSurface::~OffscreenSurface() {
-    delete[] rgb;
+    free(dirty);
+    if (ownsData)
+        free(rgb);
 }
 
 
 void OffscreenSurface::clear()
 {
-    memset(rgb, 0, 3*width*height);
+    if (ownsData)
+        memset(rgb, 0, dataSize);
+    else
+        for (unsigned y(0); y < height; ++y)
+            for (unsigned x(0); x < width; ++x)
+                memset(rgb + offset(x, y), 0, 3);
+    markAllDirty();
 }
 
 #ifdef __APPLE__
@@ -186,7 +338,7 @@ static bool saveImageToJPEG(const char *fName, CGImageRef image)
 void OffscreenSurface::saveToPNG(const std::string &name)
 {
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    CGDataProviderRef data = CGDataProviderCreateWithData(NULL, rgb, 3*width*height, NULL);
+    CGDataProviderRef data = CGDataProviderCreateWithData(NULL, getRGBData(), 3*width*height, NULL);
     CGImageRef imageRef = CGImageCreate(width, height, 8, 24, 3*width, colorSpace, kCGBitmapByteOrderDefault, data, NULL, false, kCGRenderingIntentDefault);
     saveImageToPNG(name.data(), imageRef);
     CGDataProviderRelease(data);
@@ -198,7 +350,7 @@ void OffscreenSurface::saveToPNG(const std::string &name)
 void OffscreenSurface::saveToJPEG(const std::string &name)
 {
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    CGDataProviderRef data = CGDataProviderCreateWithData(NULL, rgb, 3*width*height, NULL);
+    CGDataProviderRef data = CGDataProviderCreateWithData(NULL, getRGBData(), 3*width*height, NULL);
     CGImageRef imageRef = CGImageCreate(width, height, 8, 24, 3*width, colorSpace, kCGBitmapByteOrderDefault, data, NULL, false, kCGRenderingIntentDefault);
     saveImageToJPEG(name.data(), imageRef);
     CGDataProviderRelease(data);
@@ -27,6 +27,7 @@
 #define __Mandelbrot__OffsceenSurface__
 #include <vector>
 #include <string>
+#include <atomic>
 #include <stddef.h>
 
 template<typename T> class RGB {
@@ -67,26 +68,88 @@ private:
     std::vector< RGB<unsigned char> > data;
 };
 
+/* VGA mode 13h default palette */
+Palette BuildVGAPalette();
+
 class OffscreenSurface {
 public:
+    /* Pixel storage order: packed row-major RGB, or 64x64 tiles of 4-byte aligned RGBX pixels
+     * stored one after another, so threads rendering different tiles never share a cache line */
+    enum Layout { Linear, Tiled };
+    static const unsigned tileSize = 64;
+
     void saveToPNG(const std::string &name);
     void saveToJPEG(const std::string &name);
-    OffscreenSurface(unsigned, unsigned);
-    OffscreenSurface(unsigned, unsigned, Palette &p);
+    OffscreenSurface(unsigned, unsigned, Layout l = Linear);
+    OffscreenSurface(unsigned, unsigned, Palette &p, Layout l = Linear);
+    /* Linear surface drawing into caller owned buffer of rows stride bytes apart,
+     * pixels are either 3 byte RGB or 4 byte RGBX with the fourth byte left untouched */
+    OffscreenSurface(unsigned, unsigned, Palette &p, unsigned char *buffer, size_t stride, unsigned bytesPerPixel = 3);
     ~OffscreenSurface();
     inline unsigned getWidth() { return width; }
     inline unsigned getHeight() { return height; }
+    inline Layout getLayout() { return layout; }
+    /* Granularity renderers should align their sections to */
+    inline unsigned getAlignment() { return layout == Tiled ? tileSize : 1; }
+    /* Raw pixel storage, packed RGB only for Linear layout with default stride*/
     inline unsigned char *getData() { return rgb;}
+    /* Address of the pixel in raw storage, rows of getRowLength() pixels of getBytesPerPixel() bytes each */
+    inline unsigned char *getPixelAddress(unsigned x, unsigned y) { return rgb + offset(x, y); }
+    inline unsigned getRowLength() { return layout == Linear ? stride/bpp : tileSize; }
+    inline unsigned getBytesPerPixel() { return bpp; }
+    /* Tiles of tileSize*tileSize pixels modified since they were last taken, regardless of layout */
+    inline unsigned getTilesX() { return tilesX; }
+    inline unsigned getTilesY() { return tilesY; }
+    bool takeDirtyTile(unsigned tx, unsigned ty) { return dirty[ty*tilesX+tx].flag.exchange(false, std::memory_order_acquire); }
+    void markAllDirty();
+    /* Packed row-major RGB image, de-tiled or repacked into a staging buffer unless stored as such */
+    const unsigned char *getRGBData();
+    /* De-tile (or copy) the surface into packed row-major RGB buffer of width*height*3 bytes */
+    void copyTo(unsigned char *dst);
     void clear();
     void putPixel(unsigned x, unsigned y, RGB<unsigned char> c);
     void putPixel(unsigned, unsigned, unsigned char, unsigned char, unsigned char);
     void putPixel(unsigned, unsigned, unsigned);
-    /* Put pixel using color from the palette normalised to 0..1 range*/
+    /* Put pixel using color from the palette normalised to 0..1 range, values outside of it are clamped */
     void putPixel(unsigned, unsigned, float);
+    /* Put w*h block of palette values in row-major order, negative values mark interior points and are painted
+     * black, so renderers clamp escaping ones to 0 */
+    void putBlock(unsigned x, unsigned y, unsigned w, unsigned h, const float *vals);
+    /* Paint pixel with the average color of n palette values, negative values count as black */
+    void putSamples(unsigned x, unsigned y, const float *vals, unsigned n);
+    /* Copy color of pixel (sx, sy) to (x, y) */
+    void copyPixel(unsigned sx, unsigned sy, unsigned x, unsigned y);
     void setPalette(const Palette &p) {palette = p;}
 private:
+    /* One flag per cache line, so that workers marking neighbouring tiles do not contend */
+    struct alignas(64) DirtyFlag {
+        std::atomic<bool> flag;
+    };
+    inline void markDirty(unsigned x, unsigned y) {
+        dirty[(y/tileSize)*tilesX + x/tileSize].flag.store(true, std::memory_order_release);
+    }
+
+    OffscreenSurface(const OffscreenSurface &);
+    OffscreenSurface &operator=(const OffscreenSurface &);
+    void allocate();
+    inline bool isPacked() { return layout == Linear && bpp == 3 && stride == size_t(width)*3; }
+    RGB<unsigned char> getColor(float);
+    inline size_t offset(unsigned x, unsigned y) {
+        if (layout == Linear) return size_t(y)*stride+size_t(x)*bpp;
+        size_t tile = size_t(y/tileSize)*tilesX + x/tileSize;
+        return (tile*tileSize*tileSize + (y%tileSize)*tileSize + x%tileSize)*4;
+    }
+
     unsigned width,height;
+    Layout layout;
+    unsigned tilesX, tilesY;
+    size_t stride;
+    unsigned bpp;
+    bool ownsData;
+    size_t dataSize;
     Palette palette;
     unsigned char *rgb;
+    DirtyFlag *dirty;
+    std::vector<unsigned char> staging;
 };
 #endif /* defined(__Mandelbrot__OffsceenSurface__) */
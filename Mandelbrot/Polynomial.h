@@ -27,21 +27,31 @@
 #define Mandelbrot_Polynomial_h
 
 #include <vector>
+#include <complex>
+#include <cmath>
+#include <ostream>
 #include <algorithm>
+#include <future>
+#include <thread>
 #include <assert.h>
+#include "Complex.h"
 
 template<typename T> bool isZero(T x) { return x == 0; }
-template<> bool isZero<float>(float x) { return fabs(x)<1e-6;}
-template<> bool isZero<double>(double x) { return fabs(x)<1e-10;}
-template<> bool isZero<std::complex<float> >(std::complex<float> x) { return std::norm(x)<1e-6;}
-template<> bool isZero<std::complex<double> >(std::complex<double> x) { return std::norm(x)<1e-12;}
+template<> inline bool isZero<float>(float x) { return fabs(x)<1e-6;}
+template<> inline bool isZero<double>(double x) { return fabs(x)<1e-10;}
+template<> inline bool isZero<std::complex<float> >(std::complex<float> x) { return std::norm(x)<1e-6;}
+template<> inline bool isZero<std::complex<double> >(std::complex<double> x) { return std::norm(x)<1e-12;}
 
 
 template<typename T> bool isNegative(const T &x) { return x < 0; }
-template<> bool isNegative<std::complex<float> >(const std::complex<float> &x) { return false; }
-template<> bool isNegative<std::complex<double> >(const std::complex<double> &x) { return false; }
+template<> inline bool isNegative<std::complex<float> >(const std::complex<float> &x) { return false; }
+template<> inline bool isNegative<std::complex<double> >(const std::complex<double> &x) { return false; }
 
 
+/* Type Horner's rule accumulates values of type T in, plain arithmetic for complex numbers */
+template<typename T> struct HornerType { typedef T type; };
+template<typename T> struct HornerType<std::complex<T> > { typedef Complex<T> type; };
+
 template<typename T> class Polynomial {
 public:
     Polynomial(T c=T(0.)):coefficients(1,c) {}
@@ -52,11 +62,25 @@ public:
 
     template<typename T1> T1 operator()(const T1 x) const {
         T1 rc = 0;
-        T1 y(1);
-        for(auto c:coefficients) {
-            rc += c*y;
-            y *= x;
-        }
+        for(auto it = coefficients.rbegin(); it != coefficients.rend(); ++it)
+            rc = rc*x + *it;
+        return rc;
+    }
+
+    /* Values at all of xs, a block of points per pass over the coefficients so that their Horner steps
+     * overlap; large evaluations are split across threads, 0 meaning one per core */
+    template<typename T1> std::vector<T1> evaluate(const std::vector<T1> &xs, unsigned threads = 0) const {
+        std::vector<T1> rc(xs.size());
+        size_t work = xs.size()*coefficients.size();
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = unsigned(std::min<size_t>(threads, std::max<size_t>(1, work >> 16)));
+        std::vector<std::future<void> > workers;
+        for (unsigned i = 1; i < threads; ++i)
+            workers.push_back(std::async(std::launch::async, &Polynomial::evaluateRange<T1>, this, &xs, &rc, xs.size()*i/threads, xs.size()*(i+1)/threads));
+        evaluateRange(&xs, &rc, 0, xs.size()/threads);
+        for (auto &w: workers)
+            w.get();
         return rc;
     }
     size_t degree() const { return coefficients.size()-1;}
@@ -124,6 +148,24 @@ public:
     T operator[](size_t i) const { return i < coefficients.size() ? coefficients[i] : 0; }
     static Polynomial<T> x;
 private:
+    template<typename T1> void evaluateRange(const std::vector<T1> *xs, std::vector<T1> *rc, size_t from, size_t to) const {
+        typedef typename HornerType<T1>::type V;
+        const size_t block = 8;
+        V x[block], acc[block];
+        for (size_t i = from; i < to; i += block) {
+            size_t n = std::min(block, to - i);
+            for (size_t j = 0; j < block; ++j) {
+                x[j] = V((*xs)[std::min(i + j, to - 1)]);
+                acc[j] = V(0);
+            }
+            for (auto it = coefficients.rbegin(); it != coefficients.rend(); ++it)
+                for (size_t j = 0; j < block; ++j)
+                    acc[j] = acc[j]*x[j] + V(*it);
+            for (size_t j = 0; j < n; ++j)
+                (*rc)[i + j] = T1(acc[j]);
+        }
+    }
+
     std::vector<T> coefficients;
 };
 
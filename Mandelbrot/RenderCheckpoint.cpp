@@ -0,0 +1,156 @@
+/*
+ * Append-only checkpoint of completed tiles for resumable renders
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RenderCheckpoint.h"
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static const char checkpointMagic[8] = {'M', 'N', 'D', 'L', 'C', 'K', 'P', '1'};
+
+struct RecordHeader {
+    uint32_t tile, count;
+    double area;
+};
+
+/* FNV-1a, to tell torn records from complete ones */
+static uint32_t checksum(const void *data, size_t size, uint32_t h = 2166136261u)
+{
+    auto p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+RenderCheckpoint::RenderCheckpoint(const std::string &p, unsigned ts): path(p), tileSize(ts), syncInterval(30), out(NULL)
+{
+}
+
+RenderCheckpoint::~RenderCheckpoint()
+{
+    if (out) {
+        fflush(out);
+        fsync(fileno(out));
+        fclose(out);
+    }
+}
+
+/* Returns length of the valid prefix of the log, or -1 if it belongs to another render */
+long RenderCheckpoint::load(const std::string &key)
+{
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in) return -1;
+    char magic[sizeof(checkpointMagic)];
+    uint32_t keySize = 0;
+    std::string fileKey;
+    if (fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, checkpointMagic, sizeof(magic)) == 0 &&
+        fread(&keySize, sizeof(keySize), 1, in) == 1 && keySize == key.size()) {
+        fileKey.resize(keySize);
+        if (fread(&fileKey[0], keySize, 1, in) != 1) fileKey.clear();
+    }
+    if (fileKey != key) {
+        fclose(in);
+        return -1;
+    }
+    long valid = ftell(in);
+    RecordHeader header;
+    std::vector<float> values;
+    while (fread(&header, sizeof(header), 1, in) == 1) {
+        uint32_t sum;
+        if (header.tile >= tiles.size() || header.count > tileSize*tileSize)
+            break;
+        values.resize(header.count);
+        if (fread(values.data(), sizeof(float), header.count, in) != header.count || fread(&sum, sizeof(sum), 1, in) != 1)
+            break;
+        if (sum != checksum(values.data(), values.size()*sizeof(float), checksum(&header, sizeof(header))))
+            break;
+        auto &t = tiles[header.tile];
+        t.done = true;
+        t.area = header.area;
+        t.values.swap(values);
+        valid = ftell(in);
+    }
+    fclose(in);
+    return valid;
+}
+
+unsigned RenderCheckpoint::begin(const std::string &key, unsigned numTiles)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (out) fclose(out);
+    tiles.assign(numTiles, Tile());
+    long valid = load(key);
+    if (valid < 0) {
+        out = fopen(path.c_str(), "wb");
+        if (!out)
+            throw std::runtime_error(path + ": " + strerror(errno));
+        uint32_t keySize = key.size();
+        fwrite(checkpointMagic, sizeof(checkpointMagic), 1, out);
+        fwrite(&keySize, sizeof(keySize), 1, out);
+        fwrite(key.data(), key.size(), 1, out);
+        fflush(out);
+    } else {
+        /* Cut off torn record, if any, and continue appending */
+        if (truncate(path.c_str(), valid) < 0 || !(out = fopen(path.c_str(), "ab")))
+            throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    lastSync = std::chrono::steady_clock::now();
+    unsigned rc = 0;
+    for (auto &t: tiles)
+        rc += t.done;
+    return rc;
+}
+
+void RenderCheckpoint::save(unsigned tile, const float *values, size_t count, double area)
+{
+    RecordHeader header = {tile, uint32_t(count), area};
+    uint32_t sum = checksum(values, count*sizeof(float), checksum(&header, sizeof(header)));
+    std::lock_guard<std::mutex> guard(lock);
+    if (!out) return;
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(values, sizeof(float), count, out);
+    fwrite(&sum, sizeof(sum), 1, out);
+    /* Survives the process being killed once in the page cache, fsync only guards against losing the host */
+    fflush(out);
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - lastSync).count() >= syncInterval) {
+        fsync(fileno(out));
+        lastSync = now;
+    }
+    if (ferror(out)) {
+        std::cerr<<"Failed to write checkpoint "<<path<<", continuing without it"<<std::endl;
+        fclose(out);
+        out = NULL;
+    }
+}
+
+void RenderCheckpoint::releaseValues()
+{
+    for (auto &t: tiles)
+        std::vector<float>().swap(t.values);
+}
@@ -0,0 +1,79 @@
+/*
+ * Append-only checkpoint of completed tiles for resumable renders
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_RenderCheckpoint_h
+#define Mandelbrot_RenderCheckpoint_h
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stdio.h>
+
+/* Completed tiles are appended as they finish, together with their palette values and interior area,
+ * so that a render killed at any point resumes by replaying the log and computing the missing tiles only.
+ * Tiles that were in progress are recomputed, which costs at most one tile per thread; a log written
+ * for a different render is discarded, and a torn record at its end is cut off */
+class RenderCheckpoint {
+public:
+    RenderCheckpoint(const std::string &path, unsigned tileSize = 64);
+    ~RenderCheckpoint();
+    unsigned getTileSize() { return tileSize; }
+    /* Data is pushed to the OS after every tile, and to the disk at most once per interval */
+    void setSyncInterval(double seconds) { syncInterval = seconds; }
+    /* Open log for the render identified by key with numTiles tiles, returns number of tiles restored */
+    unsigned begin(const std::string &key, unsigned numTiles);
+    bool isDone(unsigned tile) { return tile < tiles.size() && tiles[tile].done; }
+    const std::vector<float> &getValues(unsigned tile) { return tiles[tile].values; }
+    double getArea(unsigned tile) { return tiles[tile].area; }
+    /* Forget a restored tile, e.g. one whose values do not fit, so that it is computed again */
+    void discard(unsigned tile) { if (tile < tiles.size()) tiles[tile] = Tile(); }
+    /* Thread-safe */
+    void save(unsigned tile, const float *values, size_t count, double area);
+    /* Drop restored values, once they have been painted */
+    void releaseValues();
+
+private:
+    struct Tile {
+        Tile(): done(false), area(0) {}
+        bool done;
+        double area;
+        std::vector<float> values;
+    };
+
+    RenderCheckpoint(const RenderCheckpoint &);
+    RenderCheckpoint &operator=(const RenderCheckpoint &);
+    long load(const std::string &key);
+
+    std::string path;
+    unsigned tileSize;
+    double syncInterval;
+    FILE *out;
+    std::vector<Tile> tiles;
+    std::mutex lock;
+    std::chrono::steady_clock::time_point lastSync;
+};
+
+#endif
@@ -0,0 +1,500 @@
+/*
+ * Distributed rendering of a frame by worker processes
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RenderFarm.h"
+#include "Trace.h"
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* Coordinator and workers are expected to run the same build on the same architecture,
+ * so messages carry plain native-endian structures after a header guarding against mismatch */
+static const uint32_t farmMagic = 0x4d464d00 | MANDEL_API_VERSION;
+enum { SceneMessage = 1, TaskMessage, ResultMessage };
+
+struct MessageHeader {
+    uint32_t magic, type, size;
+};
+struct TaskPayload {
+    uint32_t job, tile;
+    mandel_view view;
+};
+struct ResultPayload {
+    uint32_t job, tile;
+    int32_t status;
+};
+
+static bool isUnixAddress(const std::string &address)
+{
+    return address.compare(0, 5, "unix:") == 0 || address.find('/') != std::string::npos;
+}
+
+static int openSocket(const std::string &address, bool server)
+{
+    if (isUnixAddress(address)) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        auto path = address.compare(0, 5, "unix:") == 0 ? address.substr(5) : address;
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Socket path too long: " + path);
+        strcpy(addr.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw std::runtime_error(std::string("socket: ") + strerror(errno));
+        if (server) unlink(path.c_str());
+        int rc = server ? bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) : connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (rc < 0 || (server && listen(fd, 64) < 0)) {
+            close(fd);
+            throw std::runtime_error(address + ": " + strerror(errno));
+        }
+        return fd;
+    }
+
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("Address must be unix:path or host:port, got " + address);
+    auto host = address.substr(0, colon), port = address.substr(colon+1);
+    if (host.empty() && !server) host = "127.0.0.1";
+    addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    int err = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0)
+        throw std::runtime_error(address + ": " + gai_strerror(err));
+    int fd = -1;
+    for (auto ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        /* Task messages are tiny, do not let Nagle's algorithm hold them back */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        int rc = server ? bind(fd, ai->ai_addr, ai->ai_addrlen) : connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc < 0 || (server && listen(fd, 64) < 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        throw std::runtime_error(address + ": " + strerror(errno));
+    return fd;
+}
+
+static bool sendAll(int fd, const void *data, size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        auto rc = send(fd, p, size, 0);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) return false;
+        p += rc;
+        size -= rc;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, void *data, size_t size)
+{
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        auto rc = recv(fd, p, size, 0);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) return false;
+        p += rc;
+        size -= rc;
+    }
+    return true;
+}
+
+static bool sendMessage(int fd, uint32_t type, const void *data, size_t size, const void *extra = NULL, size_t extraSize = 0)
+{
+    MessageHeader header = {farmMagic, type, uint32_t(size + extraSize)};
+    return sendAll(fd, &header, sizeof(header)) && sendAll(fd, data, size) && (extraSize == 0 || sendAll(fd, extra, extraSize));
+}
+
+template<typename T> static void append(std::vector<unsigned char> &buf, const T &val)
+{
+    auto p = reinterpret_cast<const unsigned char *>(&val);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template<typename T> static T extract(const unsigned char *&p, const unsigned char *end)
+{
+    T rc;
+    if (p + sizeof(T) > end) throw std::runtime_error("Truncated scene message");
+    memcpy(&rc, p, sizeof(T));
+    p += sizeof(T);
+    return rc;
+}
+
+RenderFarm::RenderFarm(const std::string &addr): address(addr), listenFd(-1), tileSize(128), pipelineDepth(2), tileTimeout(60), sceneId(0), jobId(0), tilesLeft(0)
+{
+    signal(SIGPIPE, SIG_IGN);
+    listenFd = openSocket(address, true);
+}
+
+RenderFarm::~RenderFarm()
+{
+    /* Workers exit once their connection is closed */
+    for (auto &w: workers)
+        close(w.fd);
+    close(listenFd);
+    if (isUnixAddress(address))
+        unlink(address.compare(0, 5, "unix:") == 0 ? address.substr(5).c_str() : address.c_str());
+    for (auto pid: children)
+        waitpid(pid, NULL, 0);
+}
+
+void RenderFarm::spawnLocalWorkers(unsigned n, unsigned threads)
+{
+    std::cout.flush();
+    std::cerr.flush();
+    for (unsigned i = 0; i < n; ++i) {
+        pid_t pid = fork();
+        if (pid < 0)
+            throw std::runtime_error(std::string("fork: ") + strerror(errno));
+        if (pid == 0) {
+            close(listenFd);
+            for (auto &w: workers)
+                close(w.fd);
+            int rc = 0;
+            try {
+                runWorker(address, threads);
+            } catch (const std::exception &e) {
+                std::cerr<<"Worker "<<getpid()<<": "<<e.what()<<std::endl;
+                rc = 1;
+            }
+            _exit(rc);
+        }
+        children.push_back(pid);
+    }
+}
+
+void RenderFarm::acceptWorker()
+{
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) return;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    static unsigned counter = 0;
+    Worker w;
+    w.fd = fd;
+    w.id = ++counter;
+    w.name = "worker " + std::to_string(w.id);
+    w.sceneId = 0;
+    w.tilesDone = 0;
+    workers.push_back(w);
+}
+
+bool RenderFarm::dispatch(Worker &w, const FarmScene &scene, const mandel_view &view)
+{
+    unsigned tile = ~0u;
+    for (auto it = pending.begin(); it != pending.end() && tile == ~0u;) {
+        if (canTake(w, *it))
+            tile = *it;
+        if (tiles[*it].done || tile != ~0u)
+            it = pending.erase(it);
+        else
+            ++it;
+    }
+    if (tile == ~0u) {
+        /* Queue is drained: an idle worker duplicates the outstanding tile with fewest copies in flight */
+        if (!w.assigned.empty()) return false;
+        for (unsigned i = 0; i < tiles.size(); ++i)
+            if (canTake(w, i) && tiles[i].inFlight > 0 && (tile == ~0u || tiles[i].inFlight < tiles[tile].inFlight))
+                tile = i;
+        if (tile == ~0u || tiles[tile].inFlight > 1) return false;
+    }
+
+    bool ok = true;
+    if (w.sceneId != sceneId) {
+        std::vector<unsigned char> buf;
+        append<int32_t>(buf, scene.system);
+        append<int32_t>(buf, scene.renderer);
+        append(buf, scene.paramRe);
+        append(buf, scene.paramIm);
+        append<uint32_t>(buf, scene.coefficients.size());
+        for (auto c: scene.coefficients)
+            append(buf, c);
+        append<uint32_t>(buf, scene.palette.size());
+        buf.insert(buf.end(), scene.palette.begin(), scene.palette.end());
+        ok = sendMessage(w.fd, SceneMessage, buf.data(), buf.size());
+        w.sceneId = sceneId;
+    }
+    TaskPayload task;
+    task.job = jobId;
+    task.tile = tile;
+    task.view = view;
+    task.view.x = tiles[tile].x;
+    task.view.y = tiles[tile].y;
+    task.view.w = tiles[tile].w;
+    task.view.h = tiles[tile].h;
+    ok = ok && sendMessage(w.fd, TaskMessage, &task, sizeof(task));
+    /* Either way the tile is accounted to the worker, and failed connection will be dropped when polled */
+    Assignment a = {tile, clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(tileTimeout))};
+    w.assigned.push_back(a);
+    tiles[tile].inFlight++;
+    if (!ok) {
+        shutdown(w.fd, SHUT_RDWR);
+        return false;
+    }
+    return true;
+}
+
+bool RenderFarm::receive(Worker &w, const mandel_view &view, OffscreenSurface *surface)
+{
+    unsigned char buf[65536];
+    auto rc = recv(w.fd, buf, sizeof(buf), 0);
+    if (rc < 0 && errno == EINTR) return true;
+    if (rc <= 0) return false;
+    w.input.insert(w.input.end(), buf, buf + rc);
+
+    size_t consumed = 0;
+    while (w.input.size() - consumed >= sizeof(MessageHeader)) {
+        MessageHeader header;
+        memcpy(&header, &w.input[consumed], sizeof(header));
+        if (header.magic != farmMagic || header.type != ResultMessage || header.size < sizeof(ResultPayload)) {
+            std::cerr<<w.name<<" sent malformed message"<<std::endl;
+            return false;
+        }
+        if (w.input.size() - consumed < sizeof(header) + header.size) break;
+        const unsigned char *msg = &w.input[consumed + sizeof(header)];
+        consumed += sizeof(header) + header.size;
+
+        ResultPayload result;
+        memcpy(&result, msg, sizeof(result));
+        if (result.job != jobId || result.tile >= tiles.size()) continue;
+        auto it = std::find_if(w.assigned.begin(), w.assigned.end(), [&result](const Assignment &a) { return a.tile == result.tile; });
+        if (it != w.assigned.end()) {
+            w.assigned.erase(it);
+            tiles[result.tile].inFlight--;
+        }
+        auto &t = tiles[result.tile];
+        if (result.status != MANDEL_OK) {
+            /* Leave the tile to the other workers, the render fails only if all of them do */
+            std::cerr<<w.name<<" failed to render tile "<<result.tile<<": "<<mandel_strerror(result.status)<<std::endl;
+            t.failedOn.push_back(w.id);
+            if (!t.done && t.inFlight == 0)
+                requeue(result.tile);
+            continue;
+        }
+        if (header.size - sizeof(result) != size_t(t.w)*t.h*3) {
+            std::cerr<<w.name<<" sent tile of wrong size"<<std::endl;
+            return false;
+        }
+        if (t.done) continue;
+        const unsigned char *p = msg + sizeof(result);
+        for (unsigned y = 0; y < t.h; ++y)
+            for (unsigned x = 0; x < t.w; ++x, p += 3)
+                surface->putPixel(t.x + x, t.y + y, p[0], p[1], p[2]);
+        t.done = true;
+        tilesLeft--;
+        w.tilesDone++;
+    }
+    w.input.erase(w.input.begin(), w.input.begin() + consumed);
+    return true;
+}
+
+void RenderFarm::dropWorker(size_t idx)
+{
+    auto &w = workers[idx];
+    unsigned requeued = 0;
+    for (auto &a: w.assigned) {
+        if (--tiles[a.tile].inFlight == 0 && !tiles[a.tile].done) {
+            requeue(a.tile);
+            requeued++;
+        }
+    }
+    std::cerr<<w.name<<" disconnected after "<<w.tilesDone<<" tiles, "<<requeued<<" tiles queued again"<<std::endl;
+    close(w.fd);
+    workers.erase(workers.begin() + idx);
+}
+
+bool RenderFarm::canTake(const Worker &w, unsigned tile) const
+{
+    auto &t = tiles[tile];
+    return !t.done && std::find(t.failedOn.begin(), t.failedOn.end(), w.id) == t.failedOn.end() &&
+        std::find_if(w.assigned.begin(), w.assigned.end(), [tile](const Assignment &a) { return a.tile == tile; }) == w.assigned.end();
+}
+
+void RenderFarm::requeue(unsigned tile)
+{
+    if (std::find(pending.begin(), pending.end(), tile) == pending.end())
+        pending.push_front(tile);
+}
+
+int RenderFarm::checkDeadlines()
+{
+    auto now = clock::now();
+    auto next = now + std::chrono::seconds(10);
+    for (auto &w: workers)
+        for (auto &a: w.assigned) {
+            if (a.deadline <= now) {
+                /* The worker may still deliver, whichever copy arrives first is used */
+                std::cerr<<w.name<<" missed the deadline of tile "<<a.tile<<", queued again"<<std::endl;
+                a.deadline = clock::time_point::max();
+                if (!tiles[a.tile].done)
+                    requeue(a.tile);
+            } else
+                next = std::min(next, a.deadline);
+        }
+    return int(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count()) + 1;
+}
+
+void RenderFarm::checkFailures() const
+{
+    if (workers.empty()) return;
+    for (unsigned i = 0; i < tiles.size(); ++i) {
+        auto &t = tiles[i];
+        if (t.done || t.inFlight > 0 || t.failedOn.empty()) continue;
+        bool renderable = false;
+        for (auto &w: workers)
+            renderable = renderable || std::find(t.failedOn.begin(), t.failedOn.end(), w.id) == t.failedOn.end();
+        if (!renderable)
+            throw std::runtime_error("No worker could render tile " + std::to_string(i));
+    }
+}
+
+double RenderFarm::render(const FarmScene &scene, const mandel_view &view, OffscreenSurface *surface)
+{
+    if (surface->getWidth() != view.width || surface->getHeight() != view.height)
+        throw std::invalid_argument("Surface does not match the view");
+    auto start = std::chrono::steady_clock::now();
+    sceneId++;
+    jobId++;
+    tiles.clear();
+    pending.clear();
+    /* Attraction point colors only agree within one render, so such frames go out as a single tile */
+    unsigned tw = scene.renderer == MANDEL_ATTRACTION_POINT ? view.width : tileSize;
+    unsigned th = scene.renderer == MANDEL_ATTRACTION_POINT ? view.height : tileSize;
+    for (unsigned y = 0; y < view.height; y += th)
+        for (unsigned x = 0; x < view.width; x += tw) {
+            Tile t = {x, y, std::min(tw, view.width - x), std::min(th, view.height - y), 0, false};
+            pending.push_back(tiles.size());
+            tiles.push_back(t);
+        }
+    tilesLeft = tiles.size();
+    for (auto &w: workers) {
+        w.assigned.clear();
+        w.tilesDone = 0;
+    }
+
+    while (tilesLeft > 0) {
+        for (auto &w: workers)
+            while (w.assigned.size() < pipelineDepth && dispatch(w, scene, view));
+
+        std::vector<pollfd> fds(workers.size() + 1);
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            fds[i+1].fd = workers[i].fd;
+            fds[i+1].events = POLLIN;
+        }
+        int rc = poll(fds.data(), fds.size(), checkDeadlines());
+        if (rc < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("poll: ") + strerror(errno));
+        if (rc == 0 && workers.empty())
+            std::cerr<<"Waiting for workers to connect to "<<address<<std::endl;
+        if (rc <= 0) continue;
+        /* Walk backwards so that dropping a worker does not shift the ones yet to be checked */
+        for (size_t i = workers.size(); i > 0; --i)
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !receive(workers[i-1], view, surface))
+                dropWorker(i-1);
+        if (fds[0].revents & POLLIN)
+            acceptWorker();
+        checkFailures();
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    for (auto &w: workers)
+        std::cerr<<w.name<<" rendered "<<w.tilesDone<<" tiles"<<std::endl;
+    return ms;
+}
+
+void RenderFarm::runWorker(const std::string &address, unsigned threads)
+{
+    signal(SIGPIPE, SIG_IGN);
+    int fd = openSocket(address, false);
+    mandel_handle *handle = NULL;
+    std::vector<unsigned char> payload, pixels;
+    MessageHeader header;
+    while (recvAll(fd, &header, sizeof(header))) {
+        if (header.magic != farmMagic)
+            throw std::runtime_error("Coordinator speaks different protocol version");
+        payload.resize(header.size);
+        if (!recvAll(fd, payload.data(), payload.size()))
+            break;
+        if (header.type == SceneMessage) {
+            const unsigned char *p = payload.data(), *end = p + payload.size();
+            mandel_config config;
+            memset(&config, 0, sizeof(config));
+            config.system = mandel_system(extract<int32_t>(p, end));
+            config.renderer = mandel_renderer(extract<int32_t>(p, end));
+            config.param_re = extract<double>(p, end);
+            config.param_im = extract<double>(p, end);
+            std::vector<double> coefficients(extract<uint32_t>(p, end));
+            for (auto &c: coefficients)
+                c = extract<double>(p, end);
+            auto paletteSize = extract<uint32_t>(p, end);
+            if (p + paletteSize != end || (paletteSize != 0 && paletteSize != 768))
+                throw std::runtime_error("Malformed scene message");
+            config.coefficients = coefficients.data();
+            config.degree = coefficients.empty() ? 0 : coefficients.size() - 1;
+            config.palette = paletteSize ? p : NULL;
+            mandel_destroy(handle);
+            handle = mandel_create(&config);
+        } else if (header.type == TaskMessage && payload.size() == sizeof(TaskPayload)) {
+            TaskPayload task;
+            memcpy(&task, payload.data(), sizeof(task));
+            task.view.threads = threads;
+            ResultPayload result = {task.job, task.tile, MANDEL_EINVAL};
+            pixels.resize(size_t(task.view.w)*task.view.h*3);
+            TRACE_SCOPE("farmTile");
+            if (handle)
+                result.status = mandel_render(handle, &task.view, pixels.data(), size_t(task.view.w)*3, MANDEL_RGB24, NULL);
+            if (!sendMessage(fd, ResultMessage, &result, sizeof(result), pixels.data(), result.status == MANDEL_OK ? pixels.size() : 0))
+                break;
+        } else {
+            throw std::runtime_error("Unexpected message from coordinator");
+        }
+    }
+    mandel_destroy(handle);
+    close(fd);
+}
@@ -0,0 +1,120 @@
+/*
+ * Distributed rendering of a frame by worker processes
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_RenderFarm_h
+#define Mandelbrot_RenderFarm_h
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <stdint.h>
+#include <sys/types.h>
+#include "MandelLib.h"
+#include "OffsceenSurface.h"
+
+/* Everything a worker needs to build its own renderer, sent once per connection and scene change */
+struct FarmScene {
+    FarmScene(): system(MANDEL_MANDELBROT), renderer(MANDEL_ESCAPE_TIME), paramRe(0), paramIm(0) {}
+    mandel_system system;
+    mandel_renderer renderer;
+    double paramRe, paramIm;
+    std::vector<double> coefficients;
+    /* 256 RGB triplets, empty selects VGA palette */
+    std::vector<unsigned char> palette;
+};
+
+/* Splits frames into tiles and hands them out to worker processes connected over Unix ("unix:/path" or
+ * any address containing '/') or TCP ("host:port", ":port" listens on all interfaces) sockets.
+ * Workers keep a couple of tiles in flight to hide latency; once the queue drains, idle workers
+ * steal duplicates of outstanding tiles so that a straggler cannot hold up the frame. Tiles of workers
+ * that disconnect or miss the tile deadline are queued again, and a tile a worker fails to render goes
+ * to the others; the render only fails once every connected worker has failed the same tile.
+ * Workers may join or leave at any time.
+ * Attraction point renderer colours points in the order a render discovers them, so such frames
+ * are sent to a single worker as one tile */
+class RenderFarm {
+public:
+    RenderFarm(const std::string &address);
+    ~RenderFarm();
+    void setTileSize(unsigned n) { tileSize = n; }
+    /* Seconds a worker may take for a tile before it is queued for the others as well */
+    void setTileTimeout(double seconds) { tileTimeout = seconds; }
+    /* Fork n worker processes on this host connecting back to the farm */
+    void spawnLocalWorkers(unsigned n, unsigned threads = 1);
+    /* Render the whole view into surface of view.width x view.height pixels, returns time in milliseconds */
+    double render(const FarmScene &scene, const mandel_view &view, OffscreenSurface *surface);
+
+    /* Connect to the farm at address and render tiles until it goes away */
+    static void runWorker(const std::string &address, unsigned threads = 1);
+
+private:
+    typedef std::chrono::steady_clock clock;
+    struct Tile {
+        unsigned x, y, w, h;
+        unsigned inFlight;
+        bool done;
+        /* Ids of workers that reported an error for this tile */
+        std::vector<unsigned> failedOn;
+    };
+    struct Assignment {
+        unsigned tile;
+        clock::time_point deadline;
+    };
+    struct Worker {
+        int fd;
+        unsigned id;
+        std::string name;
+        unsigned sceneId;
+        std::vector<unsigned char> input;
+        std::vector<Assignment> assigned;
+        unsigned tilesDone;
+    };
+
+    RenderFarm(const RenderFarm &);
+    RenderFarm &operator=(const RenderFarm &);
+    void acceptWorker();
+    bool dispatch(Worker &w, const FarmScene &scene, const mandel_view &view);
+    bool receive(Worker &w, const mandel_view &view, OffscreenSurface *surface);
+    void dropWorker(size_t idx);
+    bool canTake(const Worker &w, unsigned tile) const;
+    void requeue(unsigned tile);
+    /* Queue tiles past their deadline again, returns milliseconds until the next deadline */
+    int checkDeadlines();
+    void checkFailures() const;
+
+    std::string address;
+    int listenFd;
+    unsigned tileSize, pipelineDepth;
+    double tileTimeout;
+    unsigned sceneId, jobId;
+    std::vector<Worker> workers;
+    std::vector<pid_t> children;
+    std::vector<Tile> tiles;
+    std::deque<unsigned> pending;
+    unsigned tilesLeft;
+};
+
+#endif
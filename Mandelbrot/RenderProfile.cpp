@@ -0,0 +1,165 @@
+/*
+ * Per-host render settings and the autotuner choosing them
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RenderProfile.h"
+#include "DynamicalSystems.h"
+#include "EscapeTimeRenderer.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <unistd.h>
+
+bool RenderProfile::load(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        auto eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        auto key = line.substr(0, eq), val = line.substr(eq+1);
+        if (key == "tileSize") tileSize = atoi(val.c_str());
+        else if (key == "threads") threads = atoi(val.c_str());
+        else if (key == "kernel") specializedKernel = val == "specialized";
+    }
+    return true;
+}
+
+bool RenderProfile::save(const std::string &path) const
+{
+    std::ofstream out(path);
+    char host[256] = "";
+    gethostname(host, sizeof(host)-1);
+    out<<"# Render profile of "<<host<<", written by mandel --autotune\n"
+       <<"tileSize="<<tileSize<<"\nthreads="<<threads<<"\nkernel="<<(specializedKernel ? "specialized" : "generic")<<"\n";
+    return bool(out);
+}
+
+std::string RenderProfile::getPath()
+{
+    auto env = getenv("MANDEL_PROFILE");
+    if (env && *env) return env;
+    char host[256] = "";
+    gethostname(host, sizeof(host)-1);
+    auto home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.mandel-profile-" + host;
+}
+
+const RenderProfile &RenderProfile::getDefault()
+{
+    static RenderProfile profile = [] {
+        RenderProfile rc;
+        if (rc.load(getPath()))
+            std::cerr<<"Using render profile "<<getPath()<<": "<<rc<<std::endl;
+        return rc;
+    }();
+    return profile;
+}
+
+std::ostream &operator<<(std::ostream &os, const RenderProfile &p)
+{
+    return os<<"tileSize="<<p.tileSize<<" threads="<<p.threads<<" kernel="<<(p.specializedKernel ? "specialized" : "generic");
+}
+
+namespace {
+struct TuneScene {
+    const char *name;
+    std::complex<double> center;
+    double radius;
+    unsigned iterations;
+    std::function<DynamicalSystem<double> *()> factory;
+};
+
+/* Milliseconds taken by the best of two renders of every scene */
+double timeProfile(const RenderProfile &p, const std::vector<TuneScene> &scenes, OffscreenSurface *surface)
+{
+    double total = 0;
+    for (auto &scene: scenes) {
+        EscapeTimeRenderer<double> renderer(surface, scene.factory);
+        std::complex<double> half(scene.radius, scene.radius);
+        renderer.setBounds(scene.center - half, scene.center + half);
+        renderer.setIterations(scene.iterations);
+        renderer.setTileSize(p.tileSize);
+        renderer.setThreads(p.threads);
+        renderer.setSpecializedKernel(p.specializedKernel);
+        double best = 0;
+        for (unsigned r = 0; r < 2; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            renderer.render();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = r == 0 ? ms : std::min(best, ms);
+        }
+        total += best;
+    }
+    return total;
+}
+}
+
+RenderProfile RenderProfile::autotune(std::ostream &log)
+{
+    /* Interior heavy, boundary heavy and escape heavy views */
+    std::vector<TuneScene> scenes = {
+        {"full-set", std::complex<double>(-.5, 0), 1.5, 512, [] { return new Mandelbrot<double>(); }},
+        {"seahorse", std::complex<double>(-0.7436438870, 0.1318259043), 1e-3, 1024, [] { return new Mandelbrot<double>(); }},
+        {"julia", std::complex<double>(0, 0), 1.6, 512, [] { return new Julia<double>(-0.8, 0.156); }},
+    };
+    Palette palette;
+    OffscreenSurface surface(320, 320, palette);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+    /* Settings interact weakly, so tune them one after another starting from the built-in defaults */
+    RenderProfile best;
+    double bestTime = timeProfile(best, scenes, &surface);
+    double baseline = bestTime;
+    log<<"baseline "<<best<<": "<<bestTime<<" ms"<<std::endl;
+    auto tryProfile = [&](const RenderProfile &p) {
+        double t = timeProfile(p, scenes, &surface);
+        log<<"         "<<p<<": "<<t<<" ms"<<std::endl;
+        /* Require a clear win, so that noise does not flip settings between runs */
+        if (t < bestTime*0.98) {
+            best = p;
+            bestTime = t;
+        }
+    };
+
+    RenderProfile candidate = best;
+    candidate.specializedKernel = !best.specializedKernel;
+    tryProfile(candidate);
+
+    auto kernelBest = best;
+    for (unsigned tile: {16u, 32u, 64u, 128u})
+        for (unsigned threads: {cores, 2*cores, 4*cores}) {
+            candidate = kernelBest;
+            candidate.tileSize = tile;
+            candidate.threads = threads;
+            tryProfile(candidate);
+        }
+    log<<"best "<<best<<": "<<bestTime<<" ms, "<<(baseline/bestTime)<<"x the baseline"<<std::endl;
+    return best;
+}
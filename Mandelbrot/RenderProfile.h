@@ -0,0 +1,56 @@
+/*
+ * Per-host render settings and the autotuner choosing them
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_RenderProfile_h
+#define Mandelbrot_RenderProfile_h
+
+#include <string>
+#include <ostream>
+
+/* Per host renderer settings tuned by autotune(), applied by the application with
+ * EscapeTimeRenderer::setProfile(); renderers themselves start from the defaults */
+struct RenderProfile {
+    RenderProfile(): tileSize(0), threads(0), specializedKernel(true) {}
+    /* 0 partitions the view into 16 sections */
+    unsigned tileSize;
+    /* 0 means one thread per section, or per core when tiling */
+    unsigned threads;
+    /* Iterate quadratic polynomials with the SIMD kernels picked for this CPU rather than through
+     * DynamicalSystem::step(); results are bit-identical, so this is on unless a profile says otherwise */
+    bool specializedKernel;
+
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+    /* $MANDEL_PROFILE, or ~/.mandel-profile-<hostname> */
+    static std::string getPath();
+    /* Profile loaded from getPath() on first use and reported on stderr, defaults when there is none */
+    static const RenderProfile &getDefault();
+    /* Time candidate settings on representative scenes, log progress and return the fastest */
+    static RenderProfile autotune(std::ostream &log);
+};
+
+std::ostream &operator<<(std::ostream &os, const RenderProfile &p);
+
+#endif
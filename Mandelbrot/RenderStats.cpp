@@ -0,0 +1,112 @@
+/*
+ * Per-tile and per-thread render counters
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RenderStats.h"
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+std::vector<ThreadStats> RenderStats::getThreadStats() const
+{
+    std::vector<ThreadStats> rc;
+    std::vector<double> lastEnd;
+    for (auto &t: tiles) {
+        if (t.thread >= rc.size()) {
+            rc.resize(t.thread+1);
+            lastEnd.resize(t.thread+1, 0);
+        }
+        auto &th = rc[t.thread];
+        th.tiles++;
+        th.iterations += t.iterations;
+        th.escaped += t.escaped;
+        th.capped += t.capped;
+        th.busyMs += t.wallMs;
+        lastEnd[t.thread] = std::max(lastEnd[t.thread], t.startMs + t.wallMs);
+    }
+    for (size_t i = 0; i < rc.size(); ++i)
+        rc[i].idleMs = std::max(0., totalMs - lastEnd[i]);
+    return rc;
+}
+
+std::string RenderStats::toJSON() const
+{
+    std::ostringstream ss;
+    uint64_t iterations = 0;
+    for (auto &t: tiles)
+        iterations += t.iterations;
+    ss<<"{\"width\":"<<width<<",\"height\":"<<height<<",\"iterationCap\":"<<iterationCap
+      <<",\"totalMs\":"<<totalMs<<",\"iterations\":"<<iterations<<",\n\"threads\":[";
+    auto threads = getThreadStats();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        auto &t = threads[i];
+        ss<<(i ? ",\n" : "\n")<<"{\"thread\":"<<i<<",\"tiles\":"<<t.tiles<<",\"iterations\":"<<t.iterations
+          <<",\"escaped\":"<<t.escaped<<",\"capped\":"<<t.capped<<",\"busyMs\":"<<t.busyMs<<",\"idleMs\":"<<t.idleMs<<"}";
+    }
+    ss<<"],\n\"tiles\":[";
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        auto &t = tiles[i];
+        ss<<(i ? ",\n" : "\n")<<"{\"x\":"<<t.x<<",\"y\":"<<t.y<<",\"w\":"<<t.w<<",\"h\":"<<t.h<<",\"thread\":"<<t.thread
+          <<",\"iterations\":"<<t.iterations<<",\"escaped\":"<<t.escaped<<",\"capped\":"<<t.capped
+          <<",\"queueWaitMs\":"<<t.startMs<<",\"wallMs\":"<<t.wallMs<<"}";
+    }
+    ss<<"]}\n";
+    return ss.str();
+}
+
+void RenderStats::saveJSON(const std::string &path) const
+{
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Can not write " + path);
+    out<<toJSON();
+}
+
+void RenderStats::paintHeatmap(OffscreenSurface *s, Metric m) const
+{
+    Palette heat(256);
+    for (unsigned i = 0; i < 256; ++i) {
+        unsigned v = i*3;
+        heat[i] = RGB<unsigned char>(std::min(v, 255u), v > 255 ? std::min(v-256, 255u) : 0, v > 511 ? v-512 : 0);
+    }
+    s->setPalette(heat);
+    s->clear();
+    auto cost = [m](const TileStats &t) {
+        double pixels = std::max(1u, t.w*t.h);
+        switch (m) {
+        case IterationsPerPixel: return t.iterations/pixels;
+        case CappedFraction: return t.capped/pixels;
+        default: return t.wallMs/pixels;
+        }
+    };
+    double maxCost = 0;
+    for (auto &t: tiles)
+        maxCost = std::max(maxCost, cost(t));
+    std::vector<float> block;
+    for (auto &t: tiles) {
+        if (t.x + t.w > s->getWidth() || t.y + t.h > s->getHeight()) continue;
+        block.assign(size_t(t.w)*t.h, maxCost > 0 ? float(cost(t)/maxCost) : 0.f);
+        s->putBlock(t.x, t.y, t.w, t.h, block.data());
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Per-tile and per-thread render counters
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_RenderStats_h
+#define Mandelbrot_RenderStats_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "OffsceenSurface.h"
+
+/* Times are in milliseconds since the render started; queue wait is how long a tile sat in the queue
+ * before a thread picked it up, i.e. its start time, as all tiles are queued up front */
+struct TileStats {
+    TileStats(): x(0), y(0), w(0), h(0), thread(0), iterations(0), computedIterations(0), escaped(0), capped(0), startMs(0), wallMs(0) {}
+    unsigned x, y, w, h;
+    unsigned thread;
+    /* In views rendered in part and mirrored, counters include the mirror images of the tile's pixels,
+     * while computedIterations are the iterations actually run */
+    uint64_t iterations, computedIterations;
+    unsigned escaped, capped;
+    double startMs, wallMs;
+};
+
+struct ThreadStats {
+    ThreadStats(): tiles(0), iterations(0), escaped(0), capped(0), busyMs(0), idleMs(0) {}
+    unsigned tiles;
+    uint64_t iterations;
+    unsigned escaped, capped;
+    /* Idle is time spent past the last tile of the thread waiting for the rest of the frame */
+    double busyMs, idleMs;
+};
+
+class RenderStats {
+public:
+    enum Metric { WallTime, IterationsPerPixel, CappedFraction };
+
+    RenderStats(): width(0), height(0), iterationCap(0), totalMs(0) {}
+    /* Tiles computed by the last render, tiles restored from checkpoint are not included */
+    std::vector<TileStats> tiles;
+    unsigned width, height, iterationCap;
+    double totalMs;
+
+    std::vector<ThreadStats> getThreadStats() const;
+    std::string toJSON() const;
+    void saveJSON(const std::string &path) const;
+    /* Paint every tile with its cost relative to the most expensive one, black to red to yellow to white */
+    void paintHeatmap(OffscreenSurface *s, Metric m = WallTime) const;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Mirror images of pixels under symmetries of a dynamical system
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_Symmetry_h
+#define Mandelbrot_Symmetry_h
+
+#include <complex>
+#include <cmath>
+
+/* Symmetries of the plane of initial values, reported by dynamical systems as a combination of flags */
+enum Symmetry {
+    /* Orbits of z and conj(z) are complex conjugates of each other */
+    ConjugateSymmetry = 1,
+    /* Orbits of z and -z are negations of each other, or coincide after the first step */
+    PointSymmetry = 2
+};
+
+/* Which pixels of a width*height view are mirror images of pixels preceding them in row-major order.
+ * A symmetry is only used if the view maps onto itself with sample points landing within
+ * a thousandth of a pixel of each other, so a mirrored pixel samples the same point as a rendered one */
+class SymmetryMap {
+public:
+    /* How to turn the result of the source pixel into the result of its mirror image */
+    enum Mirror { Identity, Conjugate, Negate, Reflect };
+
+    SymmetryMap(): conjugate(false), point(false), sumX(-1), sumY(-1), width(0), height(0) {}
+    template<typename T> SymmetryMap(unsigned symmetry, std::complex<T> topleft, std::complex<T> bottomright, unsigned w, unsigned h):
+        conjugate(symmetry & ConjugateSymmetry), point(symmetry & PointSymmetry), width(w), height(h) {
+        sumX = getMirrorSum(topleft.real(), (bottomright.real()-topleft.real())/w, w);
+        sumY = getMirrorSum(topleft.imag(), (bottomright.imag()-topleft.imag())/h, h);
+        if (sumY < 0) conjugate = false;
+        if (sumX < 0 || sumY < 0) point = false;
+    }
+
+    bool isEmpty() const { return !conjugate && !point; }
+
+    /* Pixel the result of (x, y) is copied from and how to transform it, Identity if (x, y) must be rendered */
+    Mirror getSource(unsigned x, unsigned y, unsigned &sx, unsigned &sy) const {
+        Mirror rc = Identity;
+        sx = x;
+        sy = y;
+        int mx = sumX - int(x), my = sumY - int(y);
+        bool hasX = sumX >= 0 && mx >= 0 && mx < int(width), hasY = sumY >= 0 && my >= 0 && my < int(height);
+        if (conjugate && hasY && unsigned(my) < sy) {
+            sy = my;
+            rc = Conjugate;
+        }
+        if (point && hasX && hasY && isBefore(mx, my, sx, sy)) {
+            sx = mx;
+            sy = my;
+            rc = Negate;
+        }
+        if (conjugate && point && hasX && isBefore(mx, y, sx, sy)) {
+            sx = mx;
+            sy = y;
+            rc = Reflect;
+        }
+        return rc;
+    }
+
+    bool isMirrored(unsigned x, unsigned y) const {
+        unsigned sx, sy;
+        return getSource(x, y, sx, sy) != Identity;
+    }
+
+    /* Number of pixels a rendered pixel stands for, itself included */
+    unsigned getWeight(unsigned x, unsigned y) const {
+        if (isEmpty()) return 1;
+        unsigned rc = 1;
+        int mx = sumX - int(x), my = sumY - int(y);
+        bool hasX = sumX >= 0 && mx >= 0 && mx < int(width), hasY = sumY >= 0 && my >= 0 && my < int(height);
+        bool flipX = hasX && unsigned(mx) != x, flipY = hasY && unsigned(my) != y;
+        if (conjugate && flipY) rc++;
+        /* With both symmetries the point image coincides with one of the others unless it flips both axes */
+        if (point && hasX && hasY && (conjugate ? flipX && flipY : flipX || flipY)) rc++;
+        if (conjugate && point && flipX) rc++;
+        return rc;
+    }
+
+    template<typename T> static std::complex<T> apply(Mirror m, const std::complex<T> &z) {
+        switch (m) {
+            case Conjugate: return std::conj(z);
+            case Negate: return -z;
+            case Reflect: return -std::conj(z);
+            default: return z;
+        }
+    }
+
+private:
+    static bool isBefore(int x0, int y0, unsigned x1, unsigned y1) {
+        return unsigned(y0) < y1 || (unsigned(y0) == y1 && unsigned(x0) < x1);
+    }
+
+    /* Index sum of pixel pairs on opposite sides of zero, or -1 if pixels do not line up */
+    template<typename T> static int getMirrorSum(T origin, T step, unsigned n) {
+        if (step == 0) return -1;
+        double k = -2*double(origin)/double(step);
+        if (!(std::fabs(k) < 2.0*n)) return -1;
+        int rc = int(std::floor(k + 0.5));
+        return std::fabs(k - rc) < 1e-3 && rc > 0 && rc < 2*int(n)-2 ? rc : -1;
+    }
+
+    bool conjugate, point;
+    int sumX, sumY;
+    unsigned width, height;
+};
+
+#endif
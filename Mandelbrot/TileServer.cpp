@@ -0,0 +1,440 @@
+/*
+ * Local HTTP tile server for slippy-map browsing
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TileServer.h"
+#include "EscapeTimeRenderer.h"
+#include "Trace.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const unsigned maxZoom = 28;
+static const size_t prefetchQueueSize = 256;
+/* Accepted connections waiting for a handler, beyond that the accept loop waits */
+static const size_t connectionQueueSize = 64;
+
+static const char *indexPage =
+    "<!DOCTYPE html><html><head><title>Mandelbrot</title><style>body{margin:0;overflow:hidden;background:#000}"
+    "img{position:absolute;width:256px;height:256px}</style></head><body><script>\n"
+    "var z=2,cx=512,cy=512,drag=null;\n"
+    "function draw(){var s=256,n=1<<z,w=innerWidth,h=innerHeight,html='';\n"
+    " for(var ty=Math.floor((cy-h/2)/s);ty*s<cy+h/2;ty++)for(var tx=Math.floor((cx-w/2)/s);tx*s<cx+w/2;tx++)\n"
+    "  if(tx>=0&&ty>=0&&tx<n&&ty<n)html+='<img src=\"/tiles/'+z+'/'+tx+'/'+ty+'.bmp\" style=\"left:'+(tx*s-cx+w/2)+'px;top:'+(ty*s-cy+h/2)+'px\">';\n"
+    " document.body.innerHTML=html;}\n"
+    "onmousedown=function(e){drag=[e.clientX,e.clientY];e.preventDefault();};onmouseup=function(){drag=null;};\n"
+    "onmousemove=function(e){if(!drag)return;cx-=e.clientX-drag[0];cy-=e.clientY-drag[1];drag=[e.clientX,e.clientY];draw();};\n"
+    "onwheel=function(e){var d=e.deltaY<0?1:-1;if(z+d<0||z+d>28)return;\n"
+    " var px=cx+e.clientX-innerWidth/2,py=cy+e.clientY-innerHeight/2,f=d>0?2:.5;\n"
+    " cx=px*f-(e.clientX-innerWidth/2);cy=py*f-(e.clientY-innerHeight/2);z+=d;draw();};\n"
+    "onresize=draw;draw();</script></body></html>";
+
+TileServer::TileServer(std::function<DynamicalSystem<double> *()> f, const Palette &p, const std::string &dir):
+    factory(f), palette(p), cacheDir(dir), memoryCacheSize(1024), prefetchThreads(1), connectionThreads(8),
+    listenFd(-1), stopping(false)
+{
+}
+
+TileServer::~TileServer()
+{
+    stop();
+    joinWorkers();
+}
+
+void TileServer::stop()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    prefetchReady.notify_all();
+    connectionReady.notify_all();
+    /* Wakes up accept() in run() */
+    if (listenFd >= 0)
+        shutdown(listenFd, SHUT_RDWR);
+}
+
+/* Wait for prefetches and connections being handled, dropping those not picked up yet */
+void TileServer::joinWorkers()
+{
+    for (auto &t: prefetchers)
+        t.join();
+    for (auto &t: handlers)
+        t.join();
+    prefetchers.clear();
+    handlers.clear();
+    for (auto fd: connections)
+        close(fd);
+    connections.clear();
+}
+
+/* 24-bit bottom-up BMP, which every browser displays and which needs no compression library */
+static std::vector<unsigned char> encodeBMP(OffscreenSurface &s)
+{
+    unsigned w = s.getWidth(), h = s.getHeight(), rowSize = (w*3+3)&~3u;
+    uint32_t fileSize = 54 + rowSize*h;
+    std::vector<unsigned char> rc(fileSize, 0);
+    auto put32 = [&rc](unsigned offs, uint32_t v) { for (unsigned i = 0; i < 4; ++i) rc[offs+i] = (v >> (8*i)) & 0xff; };
+    rc[0] = 'B'; rc[1] = 'M';
+    put32(2, fileSize);
+    put32(10, 54);
+    put32(14, 40);
+    put32(18, w);
+    put32(22, h);
+    rc[26] = 1;
+    rc[28] = 24;
+    put32(34, rowSize*h);
+    const unsigned char *rgb = s.getRGBData();
+    for (unsigned y = 0; y < h; ++y) {
+        const unsigned char *in = rgb + size_t(y)*w*3;
+        unsigned char *out = &rc[54 + size_t(h-1-y)*rowSize];
+        for (unsigned x = 0; x < w; ++x, in += 3, out += 3) {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+        }
+    }
+    return rc;
+}
+
+TileServer::TileData TileServer::renderTile(unsigned z, unsigned x, unsigned y)
+{
+    TRACE_SCOPE("renderTile");
+    double span = 4./(1u << z);
+    std::complex<double> tl(-2+x*span, -2+y*span);
+    OffscreenSurface surface(tileSize, tileSize, palette);
+    EscapeTimeRenderer<double> renderer(&surface, factory);
+    renderer.setBounds(tl, tl + std::complex<double>(span, span));
+    /* Deeper tiles need more iterations to resolve the boundary */
+    renderer.setIterations(std::min(256u + 128u*z, 8192u));
+    /* Concurrency comes from serving many tiles at once */
+    renderer.setThreads(1);
+    renderer.render();
+    return TileData(new std::vector<unsigned char>(encodeBMP(surface)));
+}
+
+std::string TileServer::getCachePath(unsigned z, unsigned x, unsigned y, bool create)
+{
+    std::ostringstream dir;
+    dir<<cacheDir<<"/"<<z<<"/"<<x;
+    if (create) {
+        std::string path(dir.str());
+        for (size_t pos = 1; pos != std::string::npos; pos = path.find('/', pos+1))
+            mkdir(path.substr(0, pos).c_str(), 0755);
+        mkdir(path.c_str(), 0755);
+    }
+    dir<<"/"<<y<<".bmp";
+    return dir.str();
+}
+
+TileServer::TileData TileServer::loadFromDisk(unsigned z, unsigned x, unsigned y)
+{
+    std::ifstream in(getCachePath(z, x, y, false), std::ios::binary);
+    if (!in) return TileData();
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 54 || data[0] != 'B' || data[1] != 'M') return TileData();
+    return TileData(new std::vector<unsigned char>(std::move(data)));
+}
+
+void TileServer::saveToDisk(unsigned z, unsigned x, unsigned y, const TileData &data)
+{
+    /* Write to temporary file and rename, so that concurrent readers never see partial tiles */
+    auto path = getCachePath(z, x, y, true);
+    std::ostringstream tmp;
+    tmp<<path<<".tmp."<<std::this_thread::get_id();
+    {
+        std::ofstream out(tmp.str(), std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data->data()), data->size());
+        if (!out) return;
+    }
+    rename(tmp.str().c_str(), path.c_str());
+}
+
+void TileServer::insertIntoMemory(uint64_t key, const TileData &data)
+{
+    lruList.push_front(key);
+    memory[key] = CacheEntry{data, lruList.begin()};
+    while (memory.size() > memoryCacheSize) {
+        memory.erase(lruList.back());
+        lruList.pop_back();
+    }
+}
+
+TileServer::TileData TileServer::getTile(unsigned z, unsigned x, unsigned y, bool prefetch)
+{
+    if (z > maxZoom || x >= (1u << z) || y >= (1u << z))
+        return TileData();
+    auto key = makeKey(z, x, y);
+    std::promise<TileData> result;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto &level = stats[z];
+        if (!prefetch) level.requests++;
+        auto it = memory.find(key);
+        if (it != memory.end()) {
+            lruList.splice(lruList.begin(), lruList, it->second.lru);
+            if (!prefetch) level.memoryHits++;
+            return it->second.data;
+        }
+        auto pending = inFlight.find(key);
+        if (pending != inFlight.end()) {
+            if (!prefetch) level.sharedRenders++;
+            auto f = pending->second;
+            guard.unlock();
+            return f.get();
+        }
+        inFlight[key] = result.get_future().share();
+    }
+
+    TileData data;
+    try {
+        data = loadFromDisk(z, x, y);
+        if (data) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!prefetch) stats[z].diskHits++;
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            data = renderTile(z, x, y);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+            saveToDisk(z, x, y, data);
+            std::lock_guard<std::mutex> guard(lock);
+            auto &level = stats[z];
+            if (prefetch) level.prefetches++; else level.renders++;
+            level.renderTime += ms;
+            level.maxRenderTime = std::max(level.maxRenderTime, ms);
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        inFlight.erase(key);
+        result.set_exception(std::current_exception());
+        throw;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    insertIntoMemory(key, data);
+    inFlight.erase(key);
+    result.set_value(data);
+    return data;
+}
+
+void TileServer::schedulePrefetch(unsigned z, unsigned x, unsigned y)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    unsigned n = 1u << z;
+    for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx) {
+            if ((dx == 0 && dy == 0) || (x == 0 && dx < 0) || (y == 0 && dy < 0) || x+dx >= n || y+dy >= n)
+                continue;
+            auto key = makeKey(z, x+dx, y+dy);
+            if (memory.count(key) || inFlight.count(key)) continue;
+            /* Most recent requests are the most relevant ones */
+            prefetchQueue.push_front(key);
+        }
+    while (prefetchQueue.size() > prefetchQueueSize)
+        prefetchQueue.pop_back();
+    prefetchReady.notify_all();
+}
+
+void TileServer::prefetchLoop()
+{
+    while (true) {
+        uint64_t key;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            prefetchReady.wait(guard, [this] { return stopping || !prefetchQueue.empty(); });
+            if (stopping) return;
+            key = prefetchQueue.front();
+            prefetchQueue.pop_front();
+            if (memory.count(key) || inFlight.count(key)) continue;
+        }
+        try {
+            getTile(key >> 58, (key >> 29) & ((1u << 29)-1), key & ((1u << 29)-1), true);
+        } catch (const std::exception &e) {
+            std::cerr<<"Prefetch failed: "<<e.what()<<std::endl;
+        }
+    }
+}
+
+void TileServer::connectionLoop()
+{
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            connectionReady.wait(guard, [this] { return stopping || !connections.empty(); });
+            if (stopping) return;
+            fd = connections.front();
+            connections.pop_front();
+        }
+        connectionReady.notify_all();
+        handleConnection(fd);
+    }
+}
+
+std::string TileServer::getStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::ostringstream ss;
+    ss<<"{\"memoryTiles\":"<<memory.size()<<",\"prefetchQueue\":"<<prefetchQueue.size()<<",\"levels\":[";
+    bool first = true;
+    for (auto &it: stats) {
+        auto &l = it.second;
+        auto rendered = l.renders + l.prefetches;
+        ss<<(first ? "" : ",")<<"{\"zoom\":"<<it.first<<",\"requests\":"<<l.requests
+          <<",\"memoryHits\":"<<l.memoryHits<<",\"diskHits\":"<<l.diskHits<<",\"sharedRenders\":"<<l.sharedRenders
+          <<",\"renders\":"<<l.renders<<",\"prefetches\":"<<l.prefetches
+          <<",\"hitRate\":"<<(l.requests ? double(l.requests-l.renders)/l.requests : 0)
+          <<",\"avgRenderMs\":"<<(rendered ? l.renderTime/rendered : 0)<<",\"maxRenderMs\":"<<l.maxRenderTime<<"}";
+        first = false;
+    }
+    ss<<"]}";
+    return ss.str();
+}
+
+static void sendAll(int fd, const void *data, size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        auto rc = send(fd, p, size, 0);
+        if (rc <= 0 && errno != EINTR) return;
+        if (rc > 0) { p += rc; size -= rc; }
+    }
+}
+
+static void sendResponse(int fd, const char *status, const char *contentType, const void *data, size_t size)
+{
+    std::ostringstream ss;
+    ss<<"HTTP/1.1 "<<status<<"\r\nContent-Type: "<<contentType<<"\r\nContent-Length: "<<size
+      <<"\r\nCache-Control: max-age=86400\r\nConnection: close\r\n\r\n";
+    auto header = ss.str();
+    sendAll(fd, header.data(), header.size());
+    sendAll(fd, data, size);
+}
+
+void TileServer::handleConnection(int fd)
+{
+    char buf[4096];
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384) {
+        auto rc = recv(fd, buf, sizeof(buf), 0);
+        if (rc <= 0) break;
+        request.append(buf, rc);
+    }
+    char method[16], path[1024];
+    unsigned z, x, y;
+    char ext[8];
+    if (sscanf(request.c_str(), "%15s %1023s", method, path) != 2 || strcmp(method, "GET") != 0) {
+        sendResponse(fd, "400 Bad Request", "text/plain", "Bad request\n", 12);
+    } else if (strcmp(path, "/") == 0) {
+        sendResponse(fd, "200 OK", "text/html", indexPage, strlen(indexPage));
+    } else if (strcmp(path, "/stats") == 0) {
+        auto s = getStats();
+        sendResponse(fd, "200 OK", "application/json", s.data(), s.size());
+    } else if (sscanf(path, "/tiles/%u/%u/%u.%7s", &z, &x, &y, ext) == 4 && strcmp(ext, "bmp") == 0) {
+        TileData data;
+        try {
+            data = getTile(z, x, y);
+        } catch (const std::exception &e) {
+            std::cerr<<"Tile "<<z<<"/"<<x<<"/"<<y<<" failed: "<<e.what()<<std::endl;
+        }
+        if (data) {
+            sendResponse(fd, "200 OK", "image/bmp", data->data(), data->size());
+            schedulePrefetch(z, x, y);
+        } else
+            sendResponse(fd, "404 Not Found", "text/plain", "No such tile\n", 13);
+    } else {
+        sendResponse(fd, "404 Not Found", "text/plain", "Not found\n", 10);
+    }
+    close(fd);
+}
+
+void TileServer::run(unsigned short port)
+{
+    signal(SIGPIPE, SIG_IGN);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error(std::string("socket: ") + strerror(errno));
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    /* Local browsing only */
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0)
+        throw std::runtime_error(std::string("bind: ") + strerror(errno));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping) {
+            close(fd);
+            return;
+        }
+        listenFd = fd;
+    }
+    for (unsigned i = 0; i < prefetchThreads; ++i)
+        prefetchers.emplace_back(&TileServer::prefetchLoop, this);
+    for (unsigned i = 0; i < connectionThreads; ++i)
+        handlers.emplace_back(&TileServer::connectionLoop, this);
+    std::cerr<<"Serving tiles at http://localhost:"<<port<<"/"<<std::endl;
+    std::string error;
+    while (true) {
+        int client = accept(fd, NULL, NULL);
+        std::unique_lock<std::mutex> guard(lock);
+        if (stopping) {
+            if (client >= 0) close(client);
+            break;
+        }
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            error = std::string("accept: ") + strerror(errno);
+            break;
+        }
+        /* A client that never sends its request must not hold on to a handler */
+        timeval timeout = {10, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        connectionReady.wait(guard, [this] { return stopping || connections.size() < connectionQueueSize; });
+        connections.push_back(client);
+        connectionReady.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        listenFd = -1;
+        prefetchReady.notify_all();
+        connectionReady.notify_all();
+    }
+    close(fd);
+    joinWorkers();
+    if (!error.empty())
+        throw std::runtime_error(error);
+}
@@ -0,0 +1,114 @@
+/*
+ * Local HTTP tile server for slippy-map browsing
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_TileServer_h
+#define Mandelbrot_TileServer_h
+
+#include <functional>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdint.h>
+#include "AbstractRenderer.h"
+
+/* Serves XYZ tiles of the escape time rendering of a system at http://localhost:port/tiles/z/x/y.bmp
+ * Zoom level 0 is a single tile covering [-2,2]x[-2,2]; rendered tiles are kept in an in-memory LRU
+ * backed by an on-disk cache, concurrent requests for the same tile share one render,
+ * and neighbours of requested tiles are prefetched in the background. Connections are handled by a fixed
+ * pool of threads, further ones wait in the listen backlog */
+class TileServer {
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char> > TileData;
+    static const unsigned tileSize = 256;
+
+    TileServer(std::function<DynamicalSystem<double> *()> f, const Palette &p, const std::string &cacheDir);
+    ~TileServer();
+    void setMemoryCacheSize(unsigned tiles) { memoryCacheSize = tiles; }
+    void setPrefetchThreads(unsigned n) { prefetchThreads = n; }
+    void setConnectionThreads(unsigned n) { connectionThreads = std::max(1u, n); }
+    /* Serve requests until stop() is called, then wait for the requests being handled */
+    void run(unsigned short port);
+    /* Make run() return, safe to call from any thread */
+    void stop();
+    /* BMP encoded tile, rendered or fetched from cache */
+    TileData getTile(unsigned z, unsigned x, unsigned y, bool prefetch = false);
+    /* Per zoom level hit rates and render latencies as JSON */
+    std::string getStats();
+
+private:
+    struct LevelStats {
+        LevelStats(): requests(0), memoryHits(0), diskHits(0), sharedRenders(0), renders(0), prefetches(0), renderTime(0), maxRenderTime(0) {}
+        uint64_t requests, memoryHits, diskHits, sharedRenders, renders, prefetches;
+        double renderTime, maxRenderTime;
+    };
+    struct CacheEntry {
+        TileData data;
+        std::list<uint64_t>::iterator lru;
+    };
+
+    static uint64_t makeKey(unsigned z, unsigned x, unsigned y) { return (uint64_t(z) << 58) | (uint64_t(x) << 29) | y; }
+    TileData renderTile(unsigned z, unsigned x, unsigned y);
+    std::string getCachePath(unsigned z, unsigned x, unsigned y, bool create);
+    TileData loadFromDisk(unsigned z, unsigned x, unsigned y);
+    void saveToDisk(unsigned z, unsigned x, unsigned y, const TileData &data);
+    void insertIntoMemory(uint64_t key, const TileData &data);
+    void schedulePrefetch(unsigned z, unsigned x, unsigned y);
+    void prefetchLoop();
+    void connectionLoop();
+    void handleConnection(int fd);
+    void joinWorkers();
+
+    std::function<DynamicalSystem<double> *()> factory;
+    Palette palette;
+    std::string cacheDir;
+    unsigned memoryCacheSize, prefetchThreads, connectionThreads;
+
+    std::mutex lock;
+    std::unordered_map<uint64_t, CacheEntry> memory;
+    std::list<uint64_t> lruList;
+    std::unordered_map<uint64_t, std::shared_future<TileData> > inFlight;
+    std::map<unsigned, LevelStats> stats;
+
+    std::condition_variable prefetchReady;
+    std::deque<uint64_t> prefetchQueue;
+    std::vector<std::thread> prefetchers;
+
+    std::condition_variable connectionReady;
+    std::deque<int> connections;
+    std::vector<std::thread> handlers;
+    int listenFd;
+    bool stopping;
+};
+
+#endif
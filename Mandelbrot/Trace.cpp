@@ -0,0 +1,156 @@
+/*
+ * Chrome trace event recorder
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+struct Event {
+    const char *name;
+    uint64_t start, duration;
+};
+
+/* Owned by the registry, so that events of threads which have exited are still written */
+struct ThreadBuffer {
+    ThreadBuffer(unsigned i): id(i) { events.reserve(4096); }
+    unsigned id;
+    std::string name;
+    /* Only contended while the trace is being written */
+    std::mutex lock;
+    std::vector<Event> events;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+    uint64_t origin;
+    std::string exitPath;
+};
+
+Registry &registry()
+{
+    static Registry *r = new Registry();
+    return *r;
+}
+
+ThreadBuffer &threadBuffer()
+{
+    static thread_local std::shared_ptr<ThreadBuffer> buf;
+    if (!buf) {
+        auto &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        buf = std::make_shared<ThreadBuffer>(r.buffers.size() + 1);
+        r.buffers.push_back(buf);
+    }
+    return *buf;
+}
+
+void writeAtExit()
+{
+    Trace::stop(registry().exitPath);
+}
+}
+
+std::atomic<bool> Trace::enabled(false);
+
+uint64_t Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::start()
+{
+    auto &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto &b: r.buffers) {
+        std::lock_guard<std::mutex> bufGuard(b->lock);
+        b->events.clear();
+    }
+    r.origin = now();
+    enabled.store(true);
+}
+
+void Trace::stop(const std::string &path)
+{
+    if (!enabled.exchange(false)) return;
+    auto &r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr<<"Can not write trace to "<<path<<std::endl;
+        return;
+    }
+    auto pid = getpid();
+    out<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (auto &b: r.buffers) {
+        std::lock_guard<std::mutex> bufGuard(b->lock);
+        if (!b->name.empty()) {
+            out<<(first ? "" : ",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":"<<pid<<",\"tid\":"<<b->id
+               <<",\"args\":{\"name\":\""<<b->name<<"\"}}";
+            first = false;
+        }
+        for (auto &e: b->events) {
+            /* Spans which started before tracing was turned on are clipped to its start */
+            auto start = e.start > r.origin ? e.start - r.origin : 0;
+            out<<(first ? "" : ",\n")<<"{\"name\":\""<<e.name<<"\",\"ph\":\"X\",\"pid\":"<<pid<<",\"tid\":"<<b->id
+               <<",\"ts\":"<<start<<",\"dur\":"<<e.duration<<"}";
+            first = false;
+        }
+        b->events.clear();
+    }
+    out<<"\n]}\n";
+}
+
+void Trace::startFromEnvironment()
+{
+    auto path = getenv("MANDEL_TRACE");
+    if (!path || !*path) return;
+    registry().exitPath = path;
+    atexit(writeAtExit);
+    start();
+}
+
+void Trace::setThreadName(const std::string &name)
+{
+    auto &b = threadBuffer();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.name = name;
+}
+
+void Trace::record(const char *name, uint64_t startUs, uint64_t endUs)
+{
+    auto &b = threadBuffer();
+    std::lock_guard<std::mutex> guard(b.lock);
+    Event e = {name, startUs, endUs - startUs};
+    b.events.push_back(e);
+}
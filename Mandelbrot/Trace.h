@@ -0,0 +1,74 @@
+/*
+ * Chrome trace event recorder
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef Mandelbrot_Trace_h
+#define Mandelbrot_Trace_h
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+/* Spans recorded into per-thread buffers while enabled and written out in Chrome trace event format,
+ * viewable in chrome://tracing or Perfetto. While disabled a span costs one relaxed atomic load */
+class Trace {
+public:
+    static inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    /* Drop previously recorded events and start recording */
+    static void start();
+    /* Stop recording and write events recorded since start */
+    static void stop(const std::string &path);
+    /* Record from process start if MANDEL_TRACE names an output file, which is written at exit */
+    static void startFromEnvironment();
+    /* Name shown for the calling thread */
+    static void setThreadName(const std::string &name);
+    /* Name must be a string literal, as only the pointer is kept */
+    static void record(const char *name, uint64_t startUs, uint64_t endUs);
+    /* Microseconds on the steady clock */
+    static uint64_t now();
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope {
+public:
+    TraceScope(const char *n): name(Trace::isEnabled() ? n : nullptr), start(name ? Trace::now() : 0) {}
+    ~TraceScope() { if (name) Trace::record(name, start, Trace::now()); }
+private:
+    TraceScope(const TraceScope &);
+    TraceScope &operator=(const TraceScope &);
+    const char *name;
+    uint64_t start;
+};
+
+#ifdef MANDEL_NO_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif
@@ -0,0 +1,543 @@
+/*
+ * Rendering performance benchmarks
+ *
+ * Copyright (c) 2015 Nikita Shulga
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <future>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <random>
+#include <cmath>
+#include <ctime>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "OffsceenSurface.h"
+#include "DynamicalSystems.h"
+#include "EscapeTimeRenderer.h"
+#include "AttractionPointRenderer.h"
+#include "Kernels.h"
+
+typedef std::chrono::steady_clock benchClock;
+
+static double secondsSince(benchClock::time_point start)
+{
+    return std::chrono::duration<double>(benchClock::now()-start).count();
+}
+
+/* Vertical strips are the worst case for row-major storage: every row of every strip boundary shares a cache line */
+static std::vector<std::pair<unsigned,unsigned> > partitionStrips(OffscreenSurface &s, unsigned numStrips)
+{
+    unsigned align = s.getAlignment();
+    unsigned step = std::max(align, s.getWidth()/numStrips/align*align);
+    std::vector<std::pair<unsigned,unsigned> > rc;
+    for (unsigned i(0); i < numStrips; ++i) {
+        unsigned sx = std::min(s.getWidth(), i*step);
+        unsigned ex = i+1 == numStrips ? s.getWidth() : std::min(s.getWidth(), (i+1)*step);
+        if (sx < ex) rc.push_back(std::make_pair(sx, ex));
+    }
+    return rc;
+}
+
+static void fillPixels(OffscreenSurface *s, unsigned sx, unsigned ex)
+{
+    for (unsigned y(0); y < s->getHeight(); ++y)
+        for (unsigned x(sx); x < ex; ++x)
+            s->putPixel(x, y, float((x^y)&255)/256);
+}
+
+static void fillBlocks(OffscreenSurface *s, unsigned sx, unsigned ex)
+{
+    std::vector<float> row(ex-sx);
+    for (unsigned y(0); y < s->getHeight(); ++y) {
+        for (unsigned x(sx); x < ex; ++x)
+            row[x-sx] = float((x^y)&255)/256;
+        s->putBlock(sx, y, ex-sx, 1, row.data());
+    }
+}
+
+/* Returns megapixels per second written by numThreads threads */
+static double benchFill(OffscreenSurface &s, unsigned numThreads, unsigned repeats, void (*fill)(OffscreenSurface *, unsigned, unsigned))
+{
+    auto strips = partitionStrips(s, numThreads);
+    double best = 0;
+    for (unsigned r(0); r < repeats; ++r) {
+        auto start = benchClock::now();
+        std::vector<std::future<void> > rc;
+        for (auto &strip: strips)
+            rc.push_back(std::async(std::launch::async, fill, &s, strip.first, strip.second));
+        for (auto &f: rc) f.get();
+        best = std::max(best, s.getWidth()*double(s.getHeight())/secondsSince(start)*1e-6);
+    }
+    return best;
+}
+
+/* Returns megabytes per second of packed RGB produced by copyTo */
+static double benchCopy(OffscreenSurface &s, unsigned repeats)
+{
+    std::vector<unsigned char> dst(size_t(s.getWidth())*s.getHeight()*3);
+    double best = 0;
+    for (unsigned r(0); r < repeats; ++r) {
+        auto start = benchClock::now();
+        s.copyTo(dst.data());
+        best = std::max(best, dst.size()/secondsSince(start)*1e-6);
+    }
+    return best;
+}
+
+static void benchSurface(unsigned width, unsigned height, unsigned numThreads, unsigned repeats)
+{
+    Palette palette;
+    std::cout<<"Surface "<<width<<"x"<<height<<", "<<numThreads<<" threads, best of "<<repeats<<std::endl;
+    std::cout<<std::setw(8)<<"layout"<<std::setw(16)<<"putPixel MP/s"<<std::setw(16)<<"putBlock MP/s"<<std::setw(16)<<"copyTo MB/s"<<std::endl;
+    const char *names[] = {"linear", "tiled"};
+    OffscreenSurface::Layout layouts[] = {OffscreenSurface::Linear, OffscreenSurface::Tiled};
+    for (unsigned i(0); i < 2; ++i) {
+        OffscreenSurface s(width, height, palette, layouts[i]);
+        auto pixels = benchFill(s, numThreads, repeats, fillPixels);
+        auto blocks = benchFill(s, numThreads, repeats, fillBlocks);
+        auto copy = benchCopy(s, repeats);
+        std::cout<<std::setw(8)<<names[i]<<std::fixed<<std::setprecision(1)<<std::setw(16)<<pixels<<std::setw(16)<<blocks<<std::setw(16)<<copy<<std::endl;
+    }
+}
+
+struct Sample {
+    double mean, stddev;
+};
+
+static Sample summarize(const std::vector<double> &vals)
+{
+    Sample rc = {0, 0};
+    for (auto v: vals) rc.mean += v;
+    rc.mean /= vals.size();
+    for (auto v: vals) rc.stddev += (v-rc.mean)*(v-rc.mean);
+    rc.stddev = vals.size() > 1 ? sqrt(rc.stddev/(vals.size()-1)) : 0;
+    return rc;
+}
+
+struct RenderResult {
+    std::string scene, renderer, precision;
+    unsigned threads;
+    Sample ms, pixelsPerSec, itersPerSec;
+};
+
+template<typename T> struct Scene {
+    std::string name;
+    bool attraction;
+    std::complex<T> center;
+    T radius;
+    unsigned iterations;
+    std::function<DynamicalSystem<T> *()> factory;
+};
+
+/* Fixed set of views covering cheap and expensive escape, interior heavy and root finding workloads */
+template<typename T> static std::vector<Scene<T> > buildScenes()
+{
+    auto misiurewicz = buildMisiurewiczPolynomial<T>(4, 2);
+    Polynomial<T> cube({-1, 0, 0, 1});
+    std::vector<Scene<T> > rc = {
+        {"full-set", false, std::complex<T>(-.5, 0), 1.5, 1024, [] { return new Mandelbrot<T>(); }},
+        {"seahorse-deep", false, std::complex<T>(-0.743643887037151, 0.131825904205330), 1e-6, 8192, [] { return new Mandelbrot<T>(); }},
+        {"julia", false, std::complex<T>(0, 0), 1.6, 1024, [] { return new Julia<T>(-0.8, 0.156); }},
+        {"newton-cubic", true, std::complex<T>(0, 0), 2, 256, [cube] { return new Newton<T>(cube); }},
+        {"newton-misiurewicz-4-2", true, std::complex<T>(0, 0), 2, 256, [misiurewicz] { return new Newton<T>(misiurewicz); }},
+        {"multibrot-3.5", false, std::complex<T>(0, 0), 1.5, 1024, [] { return new Multibrot<T>(3.5); }},
+    };
+    return rc;
+}
+
+/* Results must not depend on the host profile, so escape time renders run with the built-in defaults */
+template<typename Renderer> static void pinProfile(Renderer &) {}
+template<typename T> static void pinProfile(EscapeTimeRenderer<T> &r) { r.setProfile(RenderProfile()); }
+
+template<typename Renderer, typename T> static RenderResult benchRenderer(const Scene<T> &scene, unsigned size, unsigned threads, unsigned repeats)
+{
+    Palette palette;
+    OffscreenSurface surface(size, size, palette);
+    Renderer renderer(&surface, scene.factory);
+    std::complex<T> half(scene.radius, scene.radius);
+    renderer.setBounds(scene.center - half, scene.center + half);
+    renderer.setIterations(scene.iterations);
+    pinProfile(renderer);
+    renderer.setThreads(threads);
+    /* Warm up caches and let attraction points be discovered */
+    renderer.render();
+    std::vector<double> ms, pixels, iters;
+    for (unsigned r(0); r < repeats; ++r) {
+        auto start = benchClock::now();
+        renderer.render();
+        double secs = secondsSince(start);
+        ms.push_back(secs*1e3);
+        pixels.push_back(double(size)*size/secs);
+        iters.push_back(renderer.getIterationCount()/secs);
+    }
+    RenderResult rc;
+    rc.scene = scene.name;
+    rc.renderer = scene.attraction ? "attraction-point" : "escape-time";
+    rc.precision = sizeof(T) == sizeof(float) ? "float" : "double";
+    rc.threads = threads;
+    rc.ms = summarize(ms);
+    rc.pixelsPerSec = summarize(pixels);
+    rc.itersPerSec = summarize(iters);
+    return rc;
+}
+
+template<typename T> static void benchScenes(std::vector<RenderResult> &results, const std::vector<unsigned> &threadCounts, unsigned size, unsigned repeats)
+{
+    for (auto &scene: buildScenes<T>())
+        for (auto threads: threadCounts) {
+            /* Attraction point renderer is single threaded */
+            if (scene.attraction && threads != threadCounts[0]) continue;
+            auto rc = scene.attraction ? benchRenderer<AttractionPointRenderer<T> >(scene, size, 1, repeats) :
+                                         benchRenderer<EscapeTimeRenderer<T> >(scene, size, threads, repeats);
+            std::cout<<std::left<<std::setw(24)<<rc.scene<<std::setw(18)<<rc.renderer<<std::setw(8)<<rc.precision<<std::right
+                     <<std::setw(4)<<rc.threads<<std::fixed<<std::setprecision(1)<<std::setw(12)<<rc.ms.mean<<" ±"<<std::setw(6)<<rc.ms.stddev
+                     <<std::setprecision(2)<<std::setw(10)<<rc.pixelsPerSec.mean*1e-6<<std::setw(10)<<rc.itersPerSec.mean*1e-6<<std::endl;
+            results.push_back(rc);
+        }
+}
+
+static std::string resultKey(const RenderResult &r)
+{
+    return r.scene + "/" + r.renderer + "/" + r.precision + "/" + std::to_string(r.threads);
+}
+
+static void writeSample(std::ostream &out, const char *name, const Sample &s)
+{
+    out<<",\""<<name<<"\":{\"mean\":"<<s.mean<<",\"stddev\":"<<s.stddev<<"}";
+}
+
+/* One result per line, so that results can be read back without a JSON parser */
+static void writeJSON(const std::string &path, const std::string &commit, unsigned size, unsigned repeats, const std::vector<RenderResult> &results)
+{
+    std::ofstream out(path);
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host)-1);
+    out<<"{\"commit\":\""<<commit<<"\",\"host\":\""<<host<<"\",\"time\":"<<time(NULL)
+       <<",\"hardwareThreads\":"<<std::thread::hardware_concurrency()<<",\"kernels\":\""<<getKernels().name<<"\",\"size\":"<<size<<",\"repeats\":"<<repeats<<",\"results\":[\n";
+    out.precision(6);
+    for (size_t i(0); i < results.size(); ++i) {
+        auto &r = results[i];
+        out<<"{\"scene\":\""<<r.scene<<"\",\"renderer\":\""<<r.renderer<<"\",\"precision\":\""<<r.precision<<"\",\"threads\":"<<r.threads;
+        writeSample(out, "ms", r.ms);
+        writeSample(out, "pixelsPerSec", r.pixelsPerSec);
+        writeSample(out, "itersPerSec", r.itersPerSec);
+        out<<"}"<<(i+1 < results.size() ? "," : "")<<"\n";
+    }
+    out<<"]}\n";
+}
+
+static std::string jsonString(const std::string &line, const std::string &key)
+{
+    auto pos = line.find("\"" + key + "\":\"");
+    if (pos == std::string::npos) return "";
+    pos += key.size() + 4;
+    return line.substr(pos, line.find('"', pos) - pos);
+}
+
+static double jsonNumber(const std::string &line, const std::string &key)
+{
+    auto pos = line.find("\"" + key + "\":");
+    return pos == std::string::npos ? 0 : atof(line.c_str() + pos + key.size() + 3);
+}
+
+static std::map<std::string, RenderResult> readJSON(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Can not read " + path);
+    std::map<std::string, RenderResult> rc;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 9, "{\"scene\":") != 0) continue;
+        RenderResult r;
+        r.scene = jsonString(line, "scene");
+        r.renderer = jsonString(line, "renderer");
+        r.precision = jsonString(line, "precision");
+        r.threads = jsonNumber(line, "threads");
+        auto pps = line.substr(line.find("\"pixelsPerSec\""));
+        r.pixelsPerSec.mean = jsonNumber(pps, "mean");
+        r.pixelsPerSec.stddev = jsonNumber(pps, "stddev");
+        rc[resultKey(r)] = r;
+    }
+    return rc;
+}
+
+/* Flags entries whose throughput moved by more than threshold and by more than twice the combined noise */
+static int compareResults(const std::string &basePath, const std::string &newPath, double threshold)
+{
+    auto base = readJSON(basePath), current = readJSON(newPath);
+    int regressions = 0;
+    std::cout<<std::left<<std::setw(56)<<"scene/renderer/precision/threads"<<std::right<<std::setw(12)<<"base MP/s"<<std::setw(12)<<"new MP/s"<<std::setw(10)<<"change"<<std::endl;
+    for (auto &it: current) {
+        auto b = base.find(it.first);
+        if (b == base.end()) continue;
+        auto &o = b->second.pixelsPerSec, &n = it.second.pixelsPerSec;
+        double change = n.mean/o.mean - 1;
+        bool significant = fabs(n.mean - o.mean) > 2*sqrt(o.stddev*o.stddev + n.stddev*n.stddev) && fabs(change) > threshold;
+        std::cout<<std::left<<std::setw(56)<<it.first<<std::right<<std::fixed<<std::setprecision(2)<<std::setw(12)<<o.mean*1e-6<<std::setw(12)<<n.mean*1e-6
+                 <<std::setw(9)<<std::showpos<<change*100<<std::noshowpos<<"%"<<(significant ? (change < 0 ? "  REGRESSION" : "  improvement") : "")<<std::endl;
+        if (significant && change < 0) regressions++;
+    }
+    return regressions ? 1 : 0;
+}
+
+/* Multibrot as it used to be iterated, through std::pow on std::complex */
+template<typename T> class StdPowMultibrot: public DynamicalSystem<T> {
+public:
+    StdPowMultibrot(T _p): x(0, 0), c(0, 0), p(_p) {}
+    void init(std::complex<T> _c) { c = _c; x = 0; }
+    std::complex<T> step() { return x = pow(x, p) + c; }
+    std::complex<T> getVal() { return x; }
+    unsigned getSymmetry() { return Multibrot<T>(p).getSymmetry(); }
+private:
+    std::complex<T> x, c;
+    T p;
+};
+
+template<typename T> static double renderMultibrot(std::function<DynamicalSystem<T> *()> f, unsigned size, std::vector<unsigned char> &image)
+{
+    Palette palette(BuildVGAPalette());
+    OffscreenSurface surface(size, size, palette);
+    EscapeTimeRenderer<T> renderer(&surface, f);
+    renderer.setBounds(std::complex<T>(-1.5, -1.5), std::complex<T>(1.5, 1.5));
+    renderer.setIterations(256);
+    renderer.setThreads(1);
+    auto start = benchClock::now();
+    renderer.render();
+    double rc = secondsSince(start)*1e3;
+    image.assign(surface.getRGBData(), surface.getRGBData() + size_t(size)*size*3);
+    return rc;
+}
+
+/* ComplexPower against std::pow for p in [1, 5]: ns per call over points of the escape disk, largest error
+ * relative to |std::pow(x, p)|, and time of a size*size Multibrot render with either */
+static void benchPower(unsigned size, unsigned samples)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(-2, 2);
+    std::vector<std::complex<double> > xs;
+    while (xs.size() < samples) {
+        std::complex<double> x(uniform(rng), uniform(rng));
+        if (norm(x) <= 4) xs.push_back(x);
+    }
+    std::cout<<"Power of "<<samples<<" points with |x| <= 2, Multibrot "<<size<<"x"<<size<<" at 256 iterations"<<std::endl;
+    std::cout<<std::setw(6)<<"p"<<std::setw(12)<<"std ns"<<std::setw(12)<<"fast ns"<<std::setw(10)<<"speedup"<<std::setw(14)<<"max rel err"
+             <<std::setw(12)<<"std ms"<<std::setw(12)<<"fast ms"<<std::setw(10)<<"speedup"<<std::setw(10)<<"diff px"<<std::setw(14)<<"sum rel err"<<std::endl;
+    for (double p = 1; p <= 5; p += .25) {
+        ComplexPower<double> power(p);
+        /* Sums of the powers keep the timed loops from being optimized away, and are compared below */
+        std::complex<double> stdSum(0, 0), fastSum(0, 0);
+        auto start = benchClock::now();
+        for (auto &x: xs) stdSum += pow(x, p);
+        double stdNs = secondsSince(start)*1e9/xs.size();
+        start = benchClock::now();
+        for (auto &x: xs) fastSum += std::complex<double>(power(x));
+        double fastNs = secondsSince(start)*1e9/xs.size();
+        double maxErr = 0;
+        for (auto &x: xs) {
+            auto ref = pow(x, p);
+            if (norm(ref) > 0)
+                maxErr = std::max(maxErr, std::abs(std::complex<double>(power(x)) - ref)/std::abs(ref));
+        }
+        std::vector<unsigned char> stdImage, fastImage;
+        double stdMs = renderMultibrot<double>([p] { return new StdPowMultibrot<double>(p); }, size, stdImage);
+        double fastMs = renderMultibrot<double>([p] { return new Multibrot<double>(p); }, size, fastImage);
+        unsigned diff = 0;
+        for (size_t i(0); i < stdImage.size(); i += 3)
+            diff += memcmp(&stdImage[i], &fastImage[i], 3) != 0;
+        std::cout<<std::fixed<<std::setprecision(2)<<std::setw(6)<<p<<std::setw(12)<<stdNs<<std::setw(12)<<fastNs<<std::setw(9)<<stdNs/fastNs<<"x"
+                 <<std::scientific<<std::setprecision(2)<<std::setw(14)<<maxErr<<std::fixed<<std::setprecision(1)<<std::setw(12)<<stdMs<<std::setw(12)<<fastMs
+                 <<std::setprecision(2)<<std::setw(9)<<stdMs/fastMs<<"x"<<std::setw(10)<<diff
+                 <<std::scientific<<std::setprecision(2)<<std::setw(14)<<std::abs(fastSum - stdSum)/std::abs(stdSum)<<std::endl;
+    }
+}
+
+/* Systems as they used to be iterated, on std::complex */
+template<typename T> class StdComplexQuadratic: public DynamicalSystem<T> {
+public:
+    StdComplexQuadratic(bool _julia, std::complex<T> _c = 0): x(0, 0), c(_c), julia(_julia) {}
+    void init(std::complex<T> z) { if (julia) x = z; else { c = z; x = 0; } }
+    std::complex<T> step() { return x = x*x + c; }
+    std::complex<T> getVal() { return x; }
+    InteriorTrap<T> getInteriorTrap(unsigned maxIter) { return julia ? Julia<T>(c.real(), c.imag()).getInteriorTrap(maxIter) : InteriorTrap<T>(); }
+private:
+    std::complex<T> x, c;
+    bool julia;
+};
+
+template<typename T> class StdComplexMultibrot: public DynamicalSystem<T> {
+public:
+    StdComplexMultibrot(T p): x(0, 0), c(0, 0), power(p) {}
+    void init(std::complex<T> z) { c = z; x = 0; }
+    std::complex<T> step() { return x = power(x) + c; }
+    std::complex<T> getVal() { return x; }
+private:
+    std::complex<T> x, c;
+    ComplexPower<T, std::complex<T> > power;
+};
+
+template<typename T> class StdComplexNewton: public DynamicalSystem<T> {
+public:
+    StdComplexNewton(const Polynomial<T> &p): poly(p), derPoly(p.derivative()), x(0, 0) {}
+    void init(std::complex<T> z) { x = z; }
+    std::complex<T> step() { return x -= poly(x)/derPoly(x); }
+    std::complex<T> getVal() { return x; }
+private:
+    Polynomial<T> poly, derPoly;
+    std::complex<T> x;
+};
+
+template<typename Renderer> static void disableKernels(Renderer &) {}
+static void disableKernels(EscapeTimeRenderer<double> &r) { r.setSpecializedKernel(false); }
+
+/* Single threaded size*size render of f without symmetry or vectorized kernels, ms and steps per ns */
+template<typename Renderer> static std::pair<double, double> renderSystem(std::function<DynamicalSystem<double> *()> f, double radius, unsigned iterations,
+                                                                         unsigned size, std::vector<unsigned char> &image)
+{
+    Palette palette(BuildVGAPalette());
+    OffscreenSurface surface(size, size, palette);
+    Renderer renderer(&surface, f);
+    renderer.setBounds(std::complex<double>(-radius, -radius), std::complex<double>(radius, radius));
+    renderer.setIterations(iterations);
+    renderer.setThreads(1);
+    renderer.setSymmetry(false);
+    disableKernels(renderer);
+    auto start = benchClock::now();
+    renderer.render();
+    double seconds = secondsSince(start);
+    image.assign(surface.getRGBData(), surface.getRGBData() + size_t(size)*size*3);
+    return std::make_pair(seconds*1e3, renderer.getIterationCount()/seconds*1e-9);
+}
+
+template<typename Renderer> static void compareComplex(const std::string &name, std::function<DynamicalSystem<double> *()> reference,
+                                                       std::function<DynamicalSystem<double> *()> current, double radius, unsigned iterations, unsigned size, unsigned repeats)
+{
+    /* Best of interleaved runs, to keep frequency scaling and other load from favouring either */
+    std::vector<unsigned char> baselineImage, fastImage;
+    std::pair<double, double> baseline(1e300, 0), fast(1e300, 0);
+    for (unsigned i = 0; i < repeats; ++i) {
+        baseline = std::min(baseline, renderSystem<Renderer>(reference, radius, iterations, size, baselineImage));
+        fast = std::min(fast, renderSystem<Renderer>(current, radius, iterations, size, fastImage));
+    }
+    unsigned diff = 0;
+    for (size_t i(0); i < baselineImage.size(); i += 3)
+        diff += memcmp(&baselineImage[i], &fastImage[i], 3) != 0;
+    std::cout<<std::left<<std::setw(24)<<name<<std::right<<std::fixed<<std::setprecision(1)<<std::setw(12)<<baseline.first<<std::setw(12)<<fast.first
+             <<std::setprecision(2)<<std::setw(9)<<baseline.first/fast.first<<"x"<<std::setw(12)<<baseline.second<<std::setw(12)<<fast.second<<std::setw(10)<<diff<<std::endl;
+}
+
+/* Generic step() path of every system on std::complex against the Complex type it iterates on now */
+static void benchComplex(unsigned size, unsigned repeats)
+{
+    auto cube = (Polynomial<double>::x^3) - 1;
+    auto misiurewicz = buildMisiurewiczPolynomial<double>(4, 2);
+    std::cout<<"Single threaded "<<size<<"x"<<size<<" renders through DynamicalSystem::step(), best of "<<repeats<<std::endl;
+    std::cout<<std::left<<std::setw(24)<<"system"<<std::right<<std::setw(12)<<"std ms"<<std::setw(12)<<"fast ms"<<std::setw(10)<<"speedup"
+             <<std::setw(12)<<"std Gst/s"<<std::setw(12)<<"fast Gst/s"<<std::setw(10)<<"diff px"<<std::endl;
+    compareComplex<EscapeTimeRenderer<double> >("mandelbrot", [] { return new StdComplexQuadratic<double>(false); },
+                                                [] { return new Mandelbrot<double>(); }, 2, 1024, size, repeats);
+    compareComplex<EscapeTimeRenderer<double> >("julia-rabbit", [] { return new StdComplexQuadratic<double>(true, std::complex<double>(-0.123, 0.745)); },
+                                                [] { return new Julia<double>(-0.123, 0.745); }, 1.5, 1024, size, repeats);
+    compareComplex<EscapeTimeRenderer<double> >("multibrot-3", [] { return new StdComplexMultibrot<double>(3); },
+                                                [] { return new Multibrot<double>(3); }, 1.5, 1024, size, repeats);
+    compareComplex<EscapeTimeRenderer<double> >("multibrot-2.5", [] { return new StdComplexMultibrot<double>(2.5); },
+                                                [] { return new Multibrot<double>(2.5); }, 1.5, 1024, size, repeats);
+    compareComplex<AttractionPointRenderer<double> >("newton-cubic", [cube] { return new StdComplexNewton<double>(cube); },
+                                                     [cube] { return new Newton<double>(cube); }, 2, 256, size, repeats);
+    compareComplex<AttractionPointRenderer<double> >("newton-misiurewicz-4-2", [misiurewicz] { return new StdComplexNewton<double>(misiurewicz); },
+                                                     [misiurewicz] { return new Newton<double>(misiurewicz); }, 2, 256, size, repeats);
+}
+
+static void usage(const char *name)
+{
+    std::cerr<<"Usage: "<<name<<" surface [width height threads]"<<std::endl
+             <<"       "<<name<<" render [--size px] [--repeats n] [--threads n,m,...] [--commit id] [--json file]"<<std::endl
+             <<"       "<<name<<" compare base.json new.json [threshold]"<<std::endl
+             <<"       "<<name<<" power [size samples]"<<std::endl
+             <<"       "<<name<<" complex [size repeats]"<<std::endl;
+}
+
+int main(int argc, const char *argv[])
+{
+    std::string mode = argc > 1 ? argv[1] : "surface";
+    if (mode == "surface") {
+        unsigned width = argc > 2 ? atoi(argv[2]) : 1000;
+        unsigned height = argc > 3 ? atoi(argv[3]) : 1000;
+        unsigned threads = argc > 4 ? atoi(argv[4]) : 16;
+        benchSurface(width, height, threads, 10);
+        return 0;
+    }
+    if (mode == "render") {
+        unsigned size = 256, repeats = 5;
+        std::string commit = "unknown", json;
+        std::vector<unsigned> threadCounts;
+        for (int i(2); i+1 < argc; i += 2) {
+            std::string arg(argv[i]);
+            if (arg == "--size") size = atoi(argv[i+1]);
+            else if (arg == "--repeats") repeats = std::max(2, atoi(argv[i+1]));
+            else if (arg == "--commit") commit = argv[i+1];
+            else if (arg == "--json") json = argv[i+1];
+            else if (arg == "--threads") {
+                std::istringstream ss(argv[i+1]);
+                std::string n;
+                while (std::getline(ss, n, ','))
+                    threadCounts.push_back(std::max(1, atoi(n.c_str())));
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (threadCounts.empty()) {
+            threadCounts.push_back(1);
+            if (std::thread::hardware_concurrency() > 1)
+                threadCounts.push_back(std::thread::hardware_concurrency());
+        }
+        std::cout<<"Render "<<size<<"x"<<size<<", mean of "<<repeats<<" runs, commit "<<commit<<std::endl;
+        std::cout<<std::left<<std::setw(24)<<"scene"<<std::setw(18)<<"renderer"<<std::setw(8)<<"type"<<std::right<<std::setw(4)<<"thr"
+                 <<std::setw(20)<<"ms"<<std::setw(10)<<"MP/s"<<std::setw(10)<<"Miter/s"<<std::endl;
+        std::vector<RenderResult> results;
+        benchScenes<float>(results, threadCounts, size, repeats);
+        benchScenes<double>(results, threadCounts, size, repeats);
+        if (!json.empty())
+            writeJSON(json, commit, size, repeats, results);
+        return 0;
+    }
+    if (mode == "power") {
+        benchPower(argc > 2 ? atoi(argv[2]) : 192, argc > 3 ? atoi(argv[3]) : 1<<18);
+        return 0;
+    }
+    if (mode == "complex") {
+        benchComplex(argc > 2 ? atoi(argv[2]) : 512, argc > 3 ? std::max(1, atoi(argv[3])) : 5);
+        return 0;
+    }
+    if (mode == "compare" && argc > 3)
+        return compareResults(argv[2], argv[3], argc > 4 ? atof(argv[4]) : 0.03);
+    usage(argv[0]);
+    return 1;
+}